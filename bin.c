@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bin.h"
+
+Binning *
+bin_open(int in_width, int in_height,
+         int x0, int y0, int roi_width, int roi_height, int factor)
+{
+	if (factor != 1 && factor != 2 && factor != 4) {
+		fprintf(stderr, "binning factor must be 1, 2 or 4\n");
+		return NULL;
+	}
+	if (x0 < 0 || y0 < 0 || roi_width < factor || roi_height < factor
+	 || x0 + roi_width > in_width || y0 + roi_height > in_height) {
+		fprintf(stderr, "region of interest %dx%d+%d+%d outside %dx%d frame\n",
+		        roi_width, roi_height, x0, y0, in_width, in_height);
+		return NULL;
+	}
+	if (roi_width % factor || roi_height % factor) {
+		fprintf(stderr, "region of interest must be a multiple of the binning factor\n");
+		return NULL;
+	}
+
+	Binning *bn = calloc(1, sizeof *bn);
+	if (!bn) {
+		perror("calloc");
+		return NULL;
+	}
+
+	bn->in_width = in_width;
+	bn->in_height = in_height;
+	bn->x0 = x0;
+	bn->y0 = y0;
+	bn->roi_width = roi_width;
+	bn->roi_height = roi_height;
+	bn->factor = factor;
+	bn->shift = factor == 4 ? 4 : (factor == 2 ? 2 : 0);
+	bn->width = roi_width / factor;
+	bn->height = roi_height / factor;
+
+	bn->acc = malloc(roi_width * sizeof *bn->acc);
+	if (!bn->acc) {
+		perror("malloc");
+		bin_close(bn);
+		return NULL;
+	}
+
+	return bn;
+}
+
+void
+bin_close(Binning *bn)
+{
+	if (!bn)
+		return;
+
+	free(bn->acc);
+	free(bn);
+}
+
+// Crop and bin in into out, which holds bn->width * bn->height pixels.
+// Input rows are first added into 32-bit column sums, then adjacent
+// columns are combined; both loops are simple enough to vectorize.
+void
+bin_apply(const Binning *bn, const int16_t *in, int16_t *out)
+{
+	const int f = bn->factor;
+	const int rw = bn->roi_width;
+	const int ow = bn->width;
+	const int round = (1 << bn->shift) >> 1;
+	int32_t *restrict acc = bn->acc;
+
+	in += bn->y0 * bn->in_width + bn->x0;
+
+	if (f == 1) {
+		for (int y = 0; y < bn->height; y++) {
+			memcpy(out + y * ow, in + y * bn->in_width, ow * sizeof *out);
+		}
+		return;
+	}
+
+	for (int y = 0; y < bn->height; y++) {
+		const int16_t *restrict r = in + y * f * bn->in_width;
+		int16_t *restrict o = out + y * ow;
+
+		for (int x = 0; x < rw; x++) {
+			acc[x] = r[x];
+		}
+		for (int k = 1; k < f; k++) {
+			r += bn->in_width;
+			for (int x = 0; x < rw; x++) {
+				acc[x] += r[x];
+			}
+		}
+
+		if (f == 2) {
+			for (int x = 0; x < ow; x++) {
+				int32_t s = acc[2*x] + acc[2*x + 1];
+				o[x] = (s + round) >> 2;
+			}
+		} else {
+			for (int x = 0; x < ow; x++) {
+				int32_t s = acc[4*x] + acc[4*x + 1] + acc[4*x + 2] + acc[4*x + 3];
+				o[x] = (s + round) >> 4;
+			}
+		}
+	}
+}
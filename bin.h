@@ -0,0 +1,28 @@
+#ifndef BIN_H_
+#define BIN_H_
+
+#include <stdint.h>
+
+// Region of interest followed by factor x factor software binning.
+// Bins are summed in 32 bits and normalised back to per-pixel counts, so
+// binned frames keep the units (and int16 range) of unbinned ones.
+typedef struct binning {
+	int in_width;
+	int in_height;
+	int x0;           // ROI origin and size in input pixels
+	int y0;
+	int roi_width;
+	int roi_height;
+	int factor;       // 1, 2 or 4
+	int shift;        // log2(factor * factor)
+	int width;        // output geometry
+	int height;
+	int32_t *acc;     // widened column sums of one output row
+} Binning;
+
+Binning *bin_open(int in_width, int in_height,
+                  int x0, int y0, int roi_width, int roi_height, int factor);
+void bin_close(Binning *bn);
+void bin_apply(const Binning *bn, const int16_t *in, int16_t *out);
+
+#endif /* BIN_H_ */
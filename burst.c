@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "burst.h"
+#include "thermfits.h"
+
+static void *burst_thread(void *ctx);
+
+// temp_size is 0 without radiometry
+static struct burst_frame *
+burst_alloc_frames(int nslots, int npix, size_t temp_size)
+{
+	struct burst_frame *f = calloc(nslots, sizeof *f);
+	if (!f) {
+		perror("calloc");
+		return NULL;
+	}
+	for (int i = 0; i < nslots; i++) {
+		f[i].pixels = malloc(npix * sizeof *f[i].pixels);
+		f[i].temp = temp_size ? malloc(npix * temp_size) : NULL;
+		if (!f[i].pixels || (temp_size && !f[i].temp)) {
+			perror("malloc");
+			return f;
+		}
+	}
+	return f;
+}
+
+static void
+burst_free_frames(struct burst_frame *f, int nslots)
+{
+	if (!f)
+		return;
+	for (int i = 0; i < nslots; i++) {
+		free(f[i].temp);
+		free(f[i].pixels);
+	}
+	free(f);
+}
+
+// With rad the burst also keeps the scene temperature image of every
+// frame and saves it next to the counts, as for frames saved with s/S.
+Burst *
+burst_open(const Binning *bn, int pre, int post, const Radiometry *rad, int rad_scaled)
+{
+	int ret;
+
+	if (pre < 1 || post < 0) {
+		fprintf(stderr, "burst needs at least one pre-trigger frame\n");
+		return NULL;
+	}
+
+	Burst *b = calloc(1, sizeof *b);
+	if (!b) {
+		perror("calloc");
+		return NULL;
+	}
+
+	b->bn = bn;
+	b->npix = bn->width * bn->height;
+	b->pre = pre;
+	b->post = post;
+	b->nslots = pre + post;
+	b->remaining = -1;
+	b->rad = rad;
+	b->rad_scaled = rad_scaled;
+
+	size_t temp_size = !rad ? 0 : rad_scaled ? sizeof(int16_t) : sizeof(float);
+	b->ring = burst_alloc_frames(b->nslots, b->npix, temp_size);
+	b->out = burst_alloc_frames(b->nslots, b->npix, temp_size);
+	if (!b->ring || !b->out
+	 || !b->ring[b->nslots - 1].pixels || !b->out[b->nslots - 1].pixels
+	 || (rad && (!b->ring[b->nslots - 1].temp || !b->out[b->nslots - 1].temp))) {
+		burst_close(b);
+		return NULL;
+	}
+
+	b->cond_write = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+	b->mutex_write = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+
+	ret = pthread_create(&b->pthread_write, NULL, burst_thread, b);
+	if (ret) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+		burst_close(b);
+		return NULL;
+	}
+	b->started = 1;
+
+	return b;
+}
+
+// Waits for a burst still being written before returning.
+void
+burst_close(Burst *b)
+{
+	if (!b)
+		return;
+
+	if (b->started) {
+		pthread_mutex_lock(&b->mutex_write);
+		b->stop = 1;
+		pthread_cond_signal(&b->cond_write);
+		pthread_mutex_unlock(&b->mutex_write);
+		pthread_join(b->pthread_write, NULL);
+	}
+
+	burst_free_frames(b->out, b->nslots);
+	burst_free_frames(b->ring, b->nslots);
+	free(b);
+}
+
+static void
+burst_handoff(Burst *b)
+{
+	pthread_mutex_lock(&b->mutex_write);
+	struct burst_frame *tmp = b->out;
+	b->out = b->ring;
+	b->ring = tmp;
+	b->out_first = (b->head - b->count + b->nslots) % b->nslots;
+	b->out_count = b->count;
+	b->out_pre = b->count - b->post;
+	b->out_trigger = b->trigger_utc;
+	b->busy = 1;
+	pthread_cond_signal(&b->cond_write);
+	pthread_mutex_unlock(&b->mutex_write);
+
+	b->head = 0;
+	b->count = 0;
+	b->remaining = -1;
+}
+
+// Arm a burst: the frames already in the ring plus the next b->post
+// frames are saved. Returns -1 while a previous burst is pending, and -2
+// without post-trigger frames when the ring is still empty (just after
+// start or a burst), as the next frame would arrive after the trigger.
+int
+burst_trigger(Burst *b)
+{
+	int busy;
+
+	if (b->remaining >= 0)
+		return -1;
+
+	pthread_mutex_lock(&b->mutex_write);
+	busy = b->busy;
+	pthread_mutex_unlock(&b->mutex_write);
+	if (busy)
+		return -1;
+	if (b->post == 0 && b->count == 0)
+		return -2;
+
+	clock_gettime(CLOCK_REALTIME, &b->trigger_utc);
+	b->remaining = b->post;
+	if (b->count > b->pre) {
+		b->count = b->pre;
+	}
+	if (b->post == 0 && b->count > 0) {
+		burst_handoff(b);
+	}
+	return 0;
+}
+
+// Store the frame last returned by thermapp_getImage (already cropped
+// and binned to b->bn) in the ring, with its temperature image if the
+// burst was opened with radiometry. Returns 1 when it completed a burst.
+int
+burst_push(Burst *b, ThermApp *therm, const int16_t *pixels, const void *temp)
+{
+	struct burst_frame *f = &b->ring[b->head];
+
+	thermapp_getHeader(therm, &f->header);
+	thermapp_getFrameTime(therm, &f->mono, &f->utc);
+	f->temperature = thermapp_getTemperature(therm);
+	memcpy(f->pixels, pixels, b->npix * sizeof *pixels);
+	if (b->rad) {
+		memcpy(f->temp, temp, b->npix * (b->rad_scaled ? sizeof(int16_t) : sizeof(float)));
+		f->rad_temp = b->rad->lut_temp;
+	}
+
+	b->head = (b->head + 1) % b->nslots;
+	if (b->count < b->nslots) {
+		b->count++;
+	}
+
+	if (b->remaining > 0) {
+		b->remaining--;
+	}
+	if (b->remaining == 0) {
+		burst_handoff(b);
+		return 1;
+	}
+	return 0;
+}
+
+static void *
+burst_thread(void *ctx)
+{
+	Burst *b = (Burst *)ctx;
+	char fnam[BUF_LEN], radfnam[BUF_LEN];
+
+	pthread_mutex_lock(&b->mutex_write);
+	for (;;) {
+		while (!b->busy && !b->stop) {
+			pthread_cond_wait(&b->cond_write, &b->mutex_write);
+		}
+		if (!b->busy)
+			break;
+		pthread_mutex_unlock(&b->mutex_write);
+
+		// out[] is ours until busy is cleared
+		int nsaved = 0;
+		for (int i = 0; i < b->out_count; i++) {
+			struct burst_frame *f = &b->out[(b->out_first + i) % b->nslots];
+			if (get_burst_fname(fnam, &b->out_trigger, i)
+			 || write_fits_fname(f->pixels, b->bn, fnam, "BURST",
+			                     f->temperature, &f->utc, &f->mono, NULL, 0)) {
+				continue;
+			}
+			if (b->rad) {
+				get_radiometric_fname(radfnam, fnam);
+				write_fits_radiometric(f->temp, b->rad_scaled, b->bn, radfnam,
+				                       f->temperature, &f->utc, &f->mono,
+				                       b->rad, f->rad_temp);
+			}
+			nsaved++;
+		}
+		get_burst_fname(fnam, &b->out_trigger, 0);
+		fprintf(stdout,"Saved burst of %d frames (%d before trigger): %s ...\n",
+		        nsaved, b->out_pre, fnam);
+
+		pthread_mutex_lock(&b->mutex_write);
+		b->busy = 0;
+	}
+	pthread_mutex_unlock(&b->mutex_write);
+
+	return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef BURST_H_
+#define BURST_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "thermapp.h"
+#include "bin.h"
+#include "radiometry.h"
+
+#define BURST_PRE  8
+#define BURST_POST 8
+
+struct burst_frame {
+	struct cfg_packet header;
+	float temperature;
+	struct timespec mono;
+	struct timespec utc;
+	int16_t *pixels;
+	void *temp;         // scene temperature image, with radiometry
+	float rad_temp;     // detector temperature of the conversion
+};
+
+typedef struct burst {
+	const Binning *bn;  // geometry of the stored frames
+	int npix;
+	int pre;            // frames kept from before the trigger
+	int post;           // frames captured after the trigger
+	int nslots;         // pre + post
+	const Radiometry *rad;
+	int rad_scaled;     // temp[] is int16_t, else float
+
+	// Ring of the most recent frames, filled by the capture loop
+	struct burst_frame *ring;
+	int head;           // next slot to fill
+	int count;          // valid frames in ring
+	int remaining;      // post-trigger frames still to capture, -1 if idle
+	struct timespec trigger_utc;
+
+	// A completed burst is handed to the writer thread by swapping
+	// ring and out, so the capture loop never waits for the disk.
+	pthread_t pthread_write;
+	pthread_mutex_t mutex_write;
+	pthread_cond_t cond_write;
+	int started;
+	int stop;
+	int busy;           // out holds a burst not yet written
+	struct burst_frame *out;
+	int out_first;
+	int out_count;
+	int out_pre;
+	struct timespec out_trigger;
+} Burst;
+
+Burst *burst_open(const Binning *bn, int pre, int post,
+                  const Radiometry *rad, int rad_scaled);
+void burst_close(Burst *b);
+int burst_push(Burst *b, ThermApp *therm, const int16_t *pixels, const void *temp);
+int burst_trigger(Burst *b);
+
+#endif /* BURST_H_ */
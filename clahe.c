@@ -0,0 +1,258 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clahe.h"
+
+// The work per frame is one pass to find the range, one pass over the
+// tiles (a band of tile rows at a time, so the 8 histograms in use stay
+// in L1) that moves only the pixels whose bin changed, 64 small LUT
+// builds and one interpolation pass. Nothing is allocated per frame.
+
+// Interpolation between tile centres; beyond the outermost centres the
+// mapping of the edge tile is used as is.
+static void
+clahe_axis(int n, int tile, int ntiles, int *idx, uint16_t *w)
+{
+	for (int i = 0; i < n; i++) {
+		float f = (i + 0.5f) / tile - 0.5f;
+		int c = (int)floorf(f);
+		if (c < 0) {
+			c = 0;
+			f = 0;
+		}
+		if (c > ntiles - 2) {
+			c = ntiles > 1 ? ntiles - 2 : 0;
+			f = ntiles > 1 ? c + 1 : 0;
+		}
+		idx[i] = c;
+		w[i] = (uint16_t)((f - c) * 256 + 0.5f);
+	}
+}
+
+Clahe *
+clahe_open(int width, int height)
+{
+	size_t npix = (size_t)width * height;
+
+	Clahe *cl = calloc(1, sizeof *cl);
+	if (!cl) {
+		perror("calloc");
+		return NULL;
+	}
+
+	cl->width = width;
+	cl->height = height;
+	cl->clip = CLAHE_CLIP;
+	cl->tile_w = (width + CLAHE_TILES - 1) / CLAHE_TILES;
+	cl->tile_h = (height + CLAHE_TILES - 1) / CLAHE_TILES;
+	cl->ntx = (width + cl->tile_w - 1) / cl->tile_w;
+	cl->nty = (height + cl->tile_h - 1) / cl->tile_h;
+
+	int ntiles = cl->ntx * cl->nty;
+	cl->bin = malloc(npix * sizeof *cl->bin);
+	cl->row_bin = malloc(width * sizeof *cl->row_bin);
+	cl->hist = malloc(ntiles * CLAHE_BINS * sizeof *cl->hist);
+	cl->lut = malloc(ntiles * CLAHE_BINS * sizeof *cl->lut);
+	cl->tile_npix = malloc(ntiles * sizeof *cl->tile_npix);
+	cl->col_tile = malloc(width * sizeof *cl->col_tile);
+	cl->col_w = malloc(width * sizeof *cl->col_w);
+	cl->row_tile = malloc(height * sizeof *cl->row_tile);
+	cl->row_w = malloc(height * sizeof *cl->row_w);
+	if (!cl->bin || !cl->row_bin || !cl->hist || !cl->lut || !cl->tile_npix
+	 || !cl->col_tile || !cl->col_w || !cl->row_tile || !cl->row_w) {
+		perror("malloc");
+		clahe_close(cl);
+		return NULL;
+	}
+
+	for (int ty = 0; ty < cl->nty; ty++) {
+		int th = height - ty * cl->tile_h;
+		th = th < cl->tile_h ? th : cl->tile_h;
+		for (int tx = 0; tx < cl->ntx; tx++) {
+			int tw = width - tx * cl->tile_w;
+			tw = tw < cl->tile_w ? tw : cl->tile_w;
+			cl->tile_npix[ty * cl->ntx + tx] = tw * th;
+		}
+	}
+	clahe_axis(width, cl->tile_w, cl->ntx, cl->col_tile, cl->col_w);
+	clahe_axis(height, cl->tile_h, cl->nty, cl->row_tile, cl->row_w);
+
+	return cl;
+}
+
+void
+clahe_close(Clahe *cl)
+{
+	if (!cl)
+		return;
+
+	free(cl->row_w);
+	free(cl->row_tile);
+	free(cl->col_w);
+	free(cl->col_tile);
+	free(cl->tile_npix);
+	free(cl->lut);
+	free(cl->hist);
+	free(cl->row_bin);
+	free(cl->bin);
+	free(cl);
+}
+
+int
+clahe_set_clip(Clahe *cl, float clip)
+{
+	if (!(clip >= 1.0f && clip <= CLAHE_MAX_CLIP))
+		return -1;
+	cl->clip = clip;
+	return 0;
+}
+
+// Keep the histogram range unless the frame no longer fits in it or
+// uses less than half of it; a new range invalidates all histograms.
+static void
+clahe_range(Clahe *cl, const int16_t *frame)
+{
+	const int npix = cl->width * cl->height;
+	int fmin = frame[0], fmax = frame[0];
+
+	for (int i = 0; i < npix; i++) {
+		int v = frame[i];
+		fmin = v < fmin ? v : fmin;
+		fmax = v > fmax ? v : fmax;
+	}
+
+	if (cl->valid && fmin >= cl->lo && fmax <= cl->hi
+	 && 2 * (fmax - fmin) >= cl->hi - cl->lo) {
+		return;
+	}
+
+	int margin = (fmax - fmin) / 8 + 1;
+	cl->lo = fmin - margin;
+	cl->hi = fmax + margin;
+	cl->scale = ((uint32_t)CLAHE_BINS << 16) / (uint32_t)(cl->hi - cl->lo + 1);
+
+	// With every pixel cached in bin 0 and every histogram holding all of
+	// its pixels there, the incremental update rebuilds them from scratch.
+	memset(cl->bin, 0, npix * sizeof *cl->bin);
+	memset(cl->hist, 0, cl->ntx * cl->nty * CLAHE_BINS * sizeof *cl->hist);
+	for (int t = 0; t < cl->ntx * cl->nty; t++) {
+		cl->hist[t * CLAHE_BINS] = cl->tile_npix[t];
+	}
+	cl->valid = 1;
+}
+
+// Move the pixels whose bin changed since the last frame.
+static void
+clahe_update(Clahe *cl, const int16_t *frame)
+{
+	const int w = cl->width;
+	const int lo = cl->lo;
+	const uint32_t scale = cl->scale;
+	uint8_t *restrict rb = cl->row_bin;
+
+	for (int ty = 0; ty < cl->nty; ty++) {
+		const int y0 = ty * cl->tile_h;
+		const int y1 = y0 + cl->tile_h < cl->height ? y0 + cl->tile_h : cl->height;
+		uint16_t *band = cl->hist + ty * cl->ntx * CLAHE_BINS;
+
+		for (int y = y0; y < y1; y++) {
+			const int16_t *restrict r = frame + y * w;
+			uint8_t *restrict b = cl->bin + y * w;
+
+			for (int x = 0; x < w; x++) {
+				int32_t d = r[x] - lo;
+				d = d < 0 ? 0 : d;
+				uint32_t k = ((uint32_t)d * scale) >> 16;
+				rb[x] = k < CLAHE_BINS ? k : CLAHE_BINS - 1;
+			}
+			for (int tx = 0; tx < cl->ntx; tx++) {
+				uint16_t *h = band + tx * CLAHE_BINS;
+				const int x0 = tx * cl->tile_w;
+				const int x1 = x0 + cl->tile_w < w ? x0 + cl->tile_w : w;
+				for (int x = x0; x < x1; x++) {
+					if (b[x] != rb[x]) {
+						h[b[x]]--;
+						h[rb[x]]++;
+					}
+				}
+			}
+			memcpy(b, rb, w * sizeof *b);
+		}
+	}
+}
+
+// Clip one tile histogram, spread the excess evenly over all bins and
+// turn the cumulative histogram into the display mapping.
+static void
+clahe_lut(Clahe *cl, int t)
+{
+	const uint16_t *hist = cl->hist + t * CLAHE_BINS;
+	uint8_t *lut = cl->lut + t * CLAHE_BINS;
+	const uint32_t npix = cl->tile_npix[t];
+	uint32_t clip = cl->clip * npix / CLAHE_BINS;
+	uint32_t h[CLAHE_BINS];
+	uint32_t excess = 0;
+
+	clip = clip > 0 ? clip : 1;
+	for (int k = 0; k < CLAHE_BINS; k++) {
+		uint32_t v = hist[k];
+		uint32_t e = v > clip ? v - clip : 0;
+		excess += e;
+		h[k] = v - e;
+	}
+
+	uint32_t add = excess / CLAHE_BINS;
+	uint32_t rem = excess % CLAHE_BINS;
+	for (int k = 0; k < CLAHE_BINS; k++) {
+		h[k] += add;
+	}
+	if (rem) {
+		uint32_t step = CLAHE_BINS / rem;
+		for (uint32_t k = 0; k < CLAHE_BINS && rem; k += step, rem--) {
+			h[k]++;
+		}
+	}
+
+	uint32_t sum = 0;
+	for (int k = 0; k < CLAHE_BINS; k++) {
+		sum += h[k];
+		lut[k] = CLAHE_OUT_MIN
+		       + (sum * (CLAHE_OUT_MAX - CLAHE_OUT_MIN) + npix / 2) / npix;
+	}
+}
+
+// Render frame as display values (CLAHE_OUT_MIN..CLAHE_OUT_MAX) into out,
+// same size and orientation as the frame.
+void
+clahe_apply(Clahe *cl, const int16_t *frame, uint8_t *out)
+{
+	const int w = cl->width;
+	const int ntx = cl->ntx;
+
+	clahe_range(cl, frame);
+	clahe_update(cl, frame);
+	for (int t = 0; t < ntx * cl->nty; t++) {
+		clahe_lut(cl, t);
+	}
+
+	for (int y = 0; y < cl->height; y++) {
+		const int t0 = cl->row_tile[y];
+		const int t1 = cl->nty > 1 ? t0 + 1 : t0;
+		const uint32_t wy = cl->row_w[y];
+		const uint8_t *l0 = cl->lut + t0 * ntx * CLAHE_BINS;
+		const uint8_t *l1 = cl->lut + t1 * ntx * CLAHE_BINS;
+		const uint8_t *restrict b = cl->bin + y * w;
+		uint8_t *restrict o = out + y * w;
+
+		for (int x = 0; x < w; x++) {
+			const int c0 = cl->col_tile[x] * CLAHE_BINS + b[x];
+			const int c1 = ntx > 1 ? c0 + CLAHE_BINS : c0;
+			const uint32_t wx = cl->col_w[x];
+			uint32_t top = l0[c0] * (256 - wx) + l0[c1] * wx;
+			uint32_t bot = l1[c0] * (256 - wx) + l1[c1] * wx;
+			o[x] = (top * (256 - wy) + bot * wy + 32768) >> 16;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef CLAHE_H_
+#define CLAHE_H_
+
+#include <stdint.h>
+
+// Contrast-limited adaptive histogram equalization for the video output.
+// The frame is cut into a grid of tiles, each tile gets a clipped
+// histogram and the display value of a pixel is interpolated bilinearly
+// between the mappings of the four nearest tiles.
+
+#define CLAHE_TILES    8	// tiles across and down
+#define CLAHE_BINS     256	// histogram bins per tile
+#define CLAHE_CLIP     3.0f	// default clip limit, multiples of the mean bin
+#define CLAHE_MAX_CLIP 64.0f
+#define CLAHE_OUT_MIN  16	// display (luma) range of the mapping
+#define CLAHE_OUT_MAX  235
+
+typedef struct clahe {
+	int width;
+	int height;
+	int ntx;		// tile grid
+	int nty;
+	int tile_w;
+	int tile_h;
+	float clip;		// clip limit, multiples of the mean bin height
+
+	// input counts [lo, hi] are spread over the histogram bins; the range
+	// is only moved when the frame leaves it or shrinks well inside it,
+	// otherwise the histograms are updated incrementally
+	int lo;
+	int hi;
+	uint32_t scale;		// bins per count, Q16
+	int valid;		// bin[] and hist[] match lo/hi
+
+	uint8_t *bin;		// per-pixel bin in the previous frame
+	uint8_t *row_bin;	// bins of the current row
+	uint16_t *hist;		// per-tile histograms
+	uint8_t *lut;		// per-tile mapping, bin -> display value
+	uint32_t *tile_npix;
+
+	// per-column / per-row interpolation between tile centres, Q8
+	int *col_tile;
+	uint16_t *col_w;
+	int *row_tile;
+	uint16_t *row_w;
+} Clahe;
+
+Clahe *clahe_open(int width, int height);
+void clahe_close(Clahe *cl);
+int clahe_set_clip(Clahe *cl, float clip);
+void clahe_apply(Clahe *cl, const int16_t *frame, uint8_t *out);
+
+#endif /* CLAHE_H_ */
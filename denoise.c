@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "denoise.h"
+
+// All per-pixel loops below are written branch-free over flat arrays so
+// that gcc can vectorize them (-O2 -ftree-vectorize). Buffers are sized
+// once in denoise_open(), nothing is allocated per frame.
+
+static inline int16_t min16(int16_t a, int16_t b) { return a < b ? a : b; }
+static inline int16_t max16(int16_t a, int16_t b) { return a > b ? a : b; }
+
+Denoise *
+denoise_open(int width, int height)
+{
+	size_t npix = (size_t)width * height;
+
+	Denoise *dn = calloc(1, sizeof *dn);
+	if (!dn) {
+		perror("calloc");
+		return NULL;
+	}
+
+	dn->width = width;
+	dn->height = height;
+	dn->alpha = DENOISE_ALPHA;
+	dn->threshold = DENOISE_THRESHOLD;
+
+	dn->state = malloc(npix * sizeof *dn->state);
+	dn->out = malloc(npix * sizeof *dn->out);
+	dn->lo = malloc(width * sizeof *dn->lo);
+	dn->mid = malloc(width * sizeof *dn->mid);
+	dn->hi = malloc(width * sizeof *dn->hi);
+	if (!dn->state || !dn->out || !dn->lo || !dn->mid || !dn->hi) {
+		perror("malloc");
+		denoise_close(dn);
+		return NULL;
+	}
+
+	return dn;
+}
+
+void
+denoise_close(Denoise *dn)
+{
+	if (!dn)
+		return;
+
+	free(dn->hi);
+	free(dn->mid);
+	free(dn->lo);
+	free(dn->out);
+	free(dn->state);
+	free(dn);
+}
+
+// Forget the temporal history, e.g. after the pointing changed.
+void
+denoise_reset(Denoise *dn)
+{
+	dn->primed = 0;
+}
+
+int
+denoise_set_alpha(Denoise *dn, int alpha)
+{
+	if (alpha < 1 || alpha > 256)
+		return -1;
+	dn->alpha = alpha;
+	return 0;
+}
+
+int
+denoise_set_threshold(Denoise *dn, int threshold)
+{
+	if (threshold < 0 || threshold > DENOISE_MAX_THRESHOLD)
+		return -1;
+	dn->threshold = threshold;
+	return 0;
+}
+
+// y += alpha * (x - y), per pixel, in Q8 fixed point.
+// A pixel whose new value is more than threshold counts away from its
+// history is taken as motion (or a real transient) and restarts from x,
+// so moving stars do not leave trails.
+static void
+denoise_temporal(Denoise *dn, int16_t *restrict frame)
+{
+	int32_t *restrict y = dn->state;
+	const int32_t alpha = dn->alpha;
+	const int32_t gate = dn->threshold << 8;
+	const int n = dn->width * dn->height;
+
+	if (!dn->primed) {
+		for (int i = 0; i < n; i++) {
+			y[i] = (int32_t)frame[i] << 8;
+		}
+		dn->primed = 1;
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int32_t x = (int32_t)frame[i] << 8;
+		int32_t d = x - y[i];
+		// clamp before the multiply; |d| <= 2^20 keeps d * alpha in range
+		int32_t dc = d > gate ? gate : (d < -gate ? -gate : d);
+		int32_t f = y[i] + ((dc * alpha) >> 8);
+		int32_t v = (d > gate || d < -gate) ? x : f;
+		y[i] = v;
+		frame[i] = (int16_t)((v + 128) >> 8);
+	}
+}
+
+// 3x3 median. Each column's three vertical samples are sorted once per
+// output row (lo <= mid <= hi), after which the median of the 3x3 window
+// is med3(max(lo), med3(mid), min(hi)) over the three adjacent columns.
+// The border rows and columns are passed through unfiltered.
+static void
+denoise_median(Denoise *dn, int16_t *restrict frame)
+{
+	const int w = dn->width;
+	const int h = dn->height;
+	int16_t *restrict out = dn->out;
+	int16_t *restrict lo = dn->lo;
+	int16_t *restrict mid = dn->mid;
+	int16_t *restrict hi = dn->hi;
+
+	if (w < 3 || h < 3)
+		return;
+
+	memcpy(out, frame, w * sizeof *out);
+	memcpy(out + (h - 1) * w, frame + (h - 1) * w, w * sizeof *out);
+
+	for (int y = 1; y < h - 1; y++) {
+		const int16_t *restrict r0 = frame + (y - 1) * w;
+		const int16_t *restrict r1 = frame + y * w;
+		const int16_t *restrict r2 = frame + (y + 1) * w;
+		int16_t *restrict o = out + y * w;
+
+		for (int x = 0; x < w; x++) {
+			int16_t a = r0[x], b = r1[x], c = r2[x];
+			int16_t t0 = min16(a, b), t1 = max16(a, b);
+			lo[x] = min16(t0, c);
+			int16_t t2 = max16(t0, c);
+			hi[x] = max16(t1, t2);
+			mid[x] = min16(t1, t2);
+		}
+
+		for (int x = 1; x < w - 1; x++) {
+			int16_t l = max16(max16(lo[x - 1], lo[x]), lo[x + 1]);
+			int16_t u = min16(min16(hi[x - 1], hi[x]), hi[x + 1]);
+			int16_t m0 = mid[x - 1], m1 = mid[x], m2 = mid[x + 1];
+			int16_t m = max16(min16(m0, m1), min16(max16(m0, m1), m2));
+			o[x] = max16(min16(l, m), min16(max16(l, m), u));
+		}
+		o[0] = r1[0];
+		o[w - 1] = r1[w - 1];
+	}
+
+	memcpy(frame, out, (size_t)w * h * sizeof *frame);
+}
+
+// Filter a calibrated frame in place.
+void
+denoise_apply(Denoise *dn, int16_t *frame)
+{
+	if (dn->temporal) {
+		denoise_temporal(dn, frame);
+	}
+	if (dn->median) {
+		denoise_median(dn, frame);
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef DENOISE_H_
+#define DENOISE_H_
+
+#include <stdint.h>
+
+// Default recursive filter weight of the newest frame, Q8 (256 = no filtering)
+#define DENOISE_ALPHA     64
+// Default motion gate in counts: larger frame-to-frame steps bypass the filter
+#define DENOISE_THRESHOLD 40
+#define DENOISE_MAX_THRESHOLD 4096
+
+typedef struct denoise {
+	int width;
+	int height;
+
+	int temporal;     // recursive (IIR) temporal filter on/off
+	int median;       // 3x3 spatial median on/off
+	int alpha;        // weight of the newest frame, Q8, 1..256
+	int threshold;    // motion gate, counts
+
+	int primed;       // state[] holds a valid history
+	int32_t *state;   // per-pixel filter state, Q8
+	int16_t *out;     // median output frame
+	int16_t *lo;      // per-column sorted vertical triples
+	int16_t *mid;
+	int16_t *hi;
+} Denoise;
+
+Denoise *denoise_open(int width, int height);
+void denoise_close(Denoise *dn);
+void denoise_reset(Denoise *dn);
+int denoise_set_alpha(Denoise *dn, int alpha);
+int denoise_set_threshold(Denoise *dn, int threshold);
+void denoise_apply(Denoise *dn, int16_t *frame);
+
+#endif /* DENOISE_H_ */
@@ -0,0 +1,309 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "detect.h"
+
+Detect *
+detect_open(int width, int height, float nsigma)
+{
+	size_t npix = (size_t)width * height;
+
+	Detect *dt = calloc(1, sizeof *dt);
+	if (!dt) {
+		perror("calloc");
+		return NULL;
+	}
+
+	dt->width = width;
+	dt->height = height;
+	dt->nsigma = nsigma;
+	dt->min_pixels = DETECT_MIN_PIXELS;
+	dt->ncx = (width + DETECT_CELL - 1) / DETECT_CELL;
+	dt->ncy = (height + DETECT_CELL - 1) / DETECT_CELL;
+	dt->max_labels = npix / 2 + 2;
+
+	dt->cell_bg = malloc(dt->ncx * dt->ncy * sizeof *dt->cell_bg);
+	dt->cell_sigma = malloc(dt->ncx * dt->ncy * sizeof *dt->cell_sigma);
+	dt->col_cell = malloc(width * sizeof *dt->col_cell);
+	dt->col_w = malloc(width * sizeof *dt->col_w);
+	dt->row_bg = malloc(width * sizeof *dt->row_bg);
+	dt->row_thr = malloc(width * sizeof *dt->row_thr);
+	dt->resid = malloc(npix * sizeof *dt->resid);
+	dt->label = malloc(npix * sizeof *dt->label);
+	dt->parent = malloc(dt->max_labels * sizeof *dt->parent);
+	dt->sum_f = malloc(dt->max_labels * sizeof *dt->sum_f);
+	dt->sum_fx = malloc(dt->max_labels * sizeof *dt->sum_fx);
+	dt->sum_fy = malloc(dt->max_labels * sizeof *dt->sum_fy);
+	dt->peak = malloc(dt->max_labels * sizeof *dt->peak);
+	dt->area = malloc(dt->max_labels * sizeof *dt->area);
+	dt->sources = malloc(dt->max_labels * sizeof *dt->sources);
+	if (!dt->cell_bg || !dt->cell_sigma || !dt->col_cell || !dt->col_w
+	 || !dt->row_bg || !dt->row_thr || !dt->resid || !dt->label
+	 || !dt->parent || !dt->sum_f || !dt->sum_fx || !dt->sum_fy
+	 || !dt->peak || !dt->area || !dt->sources) {
+		perror("malloc");
+		detect_close(dt);
+		return NULL;
+	}
+
+	// Background is interpolated linearly between cell centres and held
+	// constant beyond the outermost ones.
+	for (int x = 0; x < width; x++) {
+		float f = (x + 0.5f) / DETECT_CELL - 0.5f;
+		int c = (int)floorf(f);
+		if (c < 0) {
+			c = 0;
+			f = 0;
+		}
+		if (c > dt->ncx - 2) {
+			c = dt->ncx > 1 ? dt->ncx - 2 : 0;
+			f = dt->ncx > 1 ? c + 1 : 0;
+		}
+		dt->col_cell[x] = c;
+		dt->col_w[x] = f - c;
+	}
+
+	return dt;
+}
+
+void
+detect_close(Detect *dt)
+{
+	if (!dt)
+		return;
+
+	free(dt->sources);
+	free(dt->area);
+	free(dt->peak);
+	free(dt->sum_fy);
+	free(dt->sum_fx);
+	free(dt->sum_f);
+	free(dt->parent);
+	free(dt->label);
+	free(dt->resid);
+	free(dt->row_thr);
+	free(dt->row_bg);
+	free(dt->col_w);
+	free(dt->col_cell);
+	free(dt->cell_sigma);
+	free(dt->cell_bg);
+	free(dt);
+}
+
+// Mean and standard deviation of one grid cell, then once more with
+// pixels beyond 3 sigma (i.e. stars) left out.
+static void
+detect_cell(Detect *dt, const int16_t *frame, int cx, int cy)
+{
+	const int w = dt->width;
+	const int x0 = cx * DETECT_CELL;
+	const int y0 = cy * DETECT_CELL;
+	const int x1 = x0 + DETECT_CELL < w ? x0 + DETECT_CELL : w;
+	const int y1 = y0 + DETECT_CELL < dt->height ? y0 + DETECT_CELL : dt->height;
+	const int n = (x1 - x0) * (y1 - y0);
+	int64_t s = 0, ss = 0;
+
+	for (int y = y0; y < y1; y++) {
+		const int16_t *restrict r = frame + y * w;
+		for (int x = x0; x < x1; x++) {
+			int32_t v = r[x];
+			s += v;
+			ss += v * v;
+		}
+	}
+	float mean = (float)s / n;
+	float var = (float)ss / n - mean * mean;
+	float sd = var > 0 ? sqrtf(var) : 0;
+
+	const float lo = mean - 3 * sd;
+	const float hi = mean + 3 * sd;
+	float cs = 0, css = 0, cn = 0;
+	for (int y = y0; y < y1; y++) {
+		const int16_t *restrict r = frame + y * w;
+		for (int x = x0; x < x1; x++) {
+			float v = r[x];
+			float in = (v >= lo && v <= hi) ? 1.0f : 0.0f;
+			cs += in * v;
+			css += in * v * v;
+			cn += in;
+		}
+	}
+	if (cn > 1) {
+		mean = cs / cn;
+		var = css / cn - mean * mean;
+		sd = var > 0 ? sqrtf(var) : 0;
+	}
+
+	dt->cell_bg[cy * dt->ncx + cx] = mean;
+	dt->cell_sigma[cy * dt->ncx + cx] = sd > 1.0f ? sd : 1.0f;
+}
+
+// Background and threshold of row y, interpolated from the cell grid.
+static void
+detect_row_background(Detect *dt, int y)
+{
+	const int ncx = dt->ncx;
+	float f = (y + 0.5f) / DETECT_CELL - 0.5f;
+	int cy = (int)floorf(f);
+
+	if (cy < 0) {
+		cy = 0;
+		f = 0;
+	}
+	if (cy > dt->ncy - 2) {
+		cy = dt->ncy > 1 ? dt->ncy - 2 : 0;
+		f = dt->ncy > 1 ? cy + 1 : 0;
+	}
+	const float wy = f - cy;
+	const int cy1 = dt->ncy > 1 ? cy + 1 : cy;
+	const float *b0 = dt->cell_bg + cy * ncx, *b1 = dt->cell_bg + cy1 * ncx;
+	const float *s0 = dt->cell_sigma + cy * ncx, *s1 = dt->cell_sigma + cy1 * ncx;
+
+	for (int x = 0; x < dt->width; x++) {
+		int c = dt->col_cell[x];
+		int c1 = ncx > 1 ? c + 1 : c;
+		float wx = dt->col_w[x];
+		float b = (b0[c] * (1 - wx) + b0[c1] * wx) * (1 - wy)
+		        + (b1[c] * (1 - wx) + b1[c1] * wx) * wy;
+		float s = (s0[c] * (1 - wx) + s0[c1] * wx) * (1 - wy)
+		        + (s1[c] * (1 - wx) + s1[c1] * wx) * wy;
+		dt->row_bg[x] = b;
+		dt->row_thr[x] = s * dt->nsigma;
+	}
+}
+
+static inline int32_t
+detect_find(int32_t *parent, int32_t x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+static inline int32_t
+detect_union(int32_t *parent, int32_t a, int32_t b)
+{
+	a = detect_find(parent, a);
+	b = detect_find(parent, b);
+	if (a < b) {
+		parent[b] = a;
+		return a;
+	}
+	parent[a] = b;
+	return b;
+}
+
+static int
+detect_cmp_flux(const void *a, const void *b)
+{
+	float fa = ((const struct detect_source *)a)->flux;
+	float fb = ((const struct detect_source *)b)->flux;
+	return (fa < fb) - (fa > fb);
+}
+
+// Find the sources in a dark-subtracted frame. The result, brightest
+// first and at most DETECT_MAX_SOURCES long, is in dt->sources.
+int
+detect_run(Detect *dt, const int16_t *frame)
+{
+	const int w = dt->width;
+	const int h = dt->height;
+	int32_t *restrict label = dt->label;
+	int32_t *restrict parent = dt->parent;
+	int32_t nlabels = 1;	// 0 is background
+
+	for (int cy = 0; cy < dt->ncy; cy++) {
+		for (int cx = 0; cx < dt->ncx; cx++) {
+			detect_cell(dt, frame, cx, cy);
+		}
+	}
+
+	// Threshold and first labelling pass (8-connected)
+	for (int y = 0; y < h; y++) {
+		const int16_t *restrict r = frame + y * w;
+		float *restrict res = dt->resid + y * w;
+		int32_t *restrict lab = label + y * w;
+		const int32_t *up = y > 0 ? lab - w : NULL;
+
+		detect_row_background(dt, y);
+		// only after the call above has written row_bg[]
+		const float *restrict bg = dt->row_bg;
+		for (int x = 0; x < w; x++) {
+			res[x] = r[x] - bg[x];
+		}
+		for (int x = 0; x < w; x++) {
+			if (res[x] <= dt->row_thr[x]) {
+				lab[x] = 0;
+				continue;
+			}
+			int32_t l = 0;
+			if (x > 0 && lab[x - 1])
+				l = lab[x - 1];
+			if (up) {
+				if (x > 0 && up[x - 1])
+					l = l ? detect_union(parent, l, up[x - 1]) : up[x - 1];
+				if (up[x])
+					l = l ? detect_union(parent, l, up[x]) : up[x];
+				if (x < w - 1 && up[x + 1])
+					l = l ? detect_union(parent, l, up[x + 1]) : up[x + 1];
+			}
+			if (!l) {
+				if (nlabels == dt->max_labels) {
+					lab[x] = 0;
+					continue;
+				}
+				l = nlabels++;
+				parent[l] = l;
+			}
+			lab[x] = l;
+		}
+	}
+
+	// Second pass: moments per connected component
+	memset(dt->sum_f, 0, nlabels * sizeof *dt->sum_f);
+	memset(dt->sum_fx, 0, nlabels * sizeof *dt->sum_fx);
+	memset(dt->sum_fy, 0, nlabels * sizeof *dt->sum_fy);
+	memset(dt->peak, 0, nlabels * sizeof *dt->peak);
+	memset(dt->area, 0, nlabels * sizeof *dt->area);
+	for (int y = 0; y < h; y++) {
+		const int32_t *lab = label + y * w;
+		const float *res = dt->resid + y * w;
+		for (int x = 0; x < w; x++) {
+			if (!lab[x])
+				continue;
+			int32_t l = detect_find(parent, lab[x]);
+			float f = res[x];
+			dt->sum_f[l] += f;
+			dt->sum_fx[l] += f * x;
+			dt->sum_fy[l] += f * y;
+			dt->area[l]++;
+			if (f > dt->peak[l])
+				dt->peak[l] = f;
+		}
+	}
+
+	int n = 0;
+	for (int32_t l = 1; l < nlabels; l++) {
+		if (parent[l] != l || dt->area[l] < (uint32_t)dt->min_pixels)
+			continue;
+		struct detect_source *s = &dt->sources[n++];
+		s->x = dt->sum_fx[l] / dt->sum_f[l];
+		s->y = dt->sum_fy[l] / dt->sum_f[l];
+		s->flux = dt->sum_f[l];
+		s->peak = dt->peak[l];
+		s->npix = dt->area[l];
+		s->pad = 0;
+	}
+
+	qsort(dt->sources, n, sizeof *dt->sources, detect_cmp_flux);
+	if (n > DETECT_MAX_SOURCES) {
+		n = DETECT_MAX_SOURCES;
+	}
+	dt->nsources = n;
+
+	return n;
+}
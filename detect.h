@@ -0,0 +1,58 @@
+#ifndef DETECT_H_
+#define DETECT_H_
+
+#include <stdint.h>
+
+#define DETECT_CELL        32	// background grid cell, pixels
+#define DETECT_SIGMA       5.0f	// detection threshold above background, sigma
+#define DETECT_MIN_PIXELS  3	// smallest accepted source
+#define DETECT_MAX_SOURCES 128	// brightest sources kept per frame
+
+struct detect_source {
+	float x;		// flux weighted centroid, 0-based pixels
+	float y;
+	float flux;		// background subtracted sum, counts
+	float peak;		// brightest pixel above background
+	uint32_t npix;		// pixels above threshold
+	uint32_t pad;
+};
+
+typedef struct detect {
+	int width;
+	int height;
+	float nsigma;
+	int min_pixels;
+
+	// background grid, one value per cell
+	int ncx;
+	int ncy;
+	float *cell_bg;
+	float *cell_sigma;
+
+	// per-column interpolation between cell centres
+	int *col_cell;
+	float *col_w;
+
+	float *row_bg;		// background and threshold of the current row
+	float *row_thr;
+	float *resid;		// background subtracted frame
+	int32_t *label;
+	int32_t *parent;	// union-find over provisional labels
+	int max_labels;
+
+	// per-label moments, indexed by root label
+	double *sum_f;
+	double *sum_fx;
+	double *sum_fy;
+	float *peak;
+	uint32_t *area;
+
+	struct detect_source *sources;
+	int nsources;
+} Detect;
+
+Detect *detect_open(int width, int height, float nsigma);
+void detect_close(Detect *dt);
+int detect_run(Detect *dt, const int16_t *frame);
+
+#endif /* DETECT_H_ */
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "thermapp.h"
+#include "framebus.h"
+
+#define ROUND_UP_64(num) (((num)+63)&~63)
+
+_Static_assert(sizeof(struct cfg_packet) == FRAMEBUS_HEADER_WORDS * sizeof(uint16_t),
+               "framebus header size does not match struct cfg_packet");
+
+static inline struct framebus_slot *
+framebus_slot(const FrameBus *bus, uint32_t frame)
+{
+	uint32_t i = frame % bus->hdr->nslots;
+	return (struct framebus_slot *)((char *)bus->hdr
+	       + ROUND_UP_64(sizeof *bus->hdr) + (size_t)i * bus->hdr->slot_size);
+}
+
+FrameBus *
+framebus_create(const char *name, int raw_width, int raw_height,
+                int cal_width, int cal_height, int nslots)
+{
+	size_t raw_size = ROUND_UP_64(raw_width * raw_height * sizeof(int16_t));
+	size_t cal_size = ROUND_UP_64(cal_width * cal_height * sizeof(int16_t));
+	size_t src_size = ROUND_UP_64(DETECT_MAX_SOURCES * sizeof(struct detect_source));
+	size_t slot_size = ROUND_UP_64(sizeof(struct framebus_slot)) + raw_size + cal_size + src_size;
+
+	FrameBus *bus = calloc(1, sizeof *bus);
+	if (!bus) {
+		perror("calloc");
+		return NULL;
+	}
+	bus->fd = -1;
+	bus->owner = 1;
+	snprintf(bus->name, sizeof bus->name, "%s", name);
+	bus->size = ROUND_UP_64(sizeof(struct framebus_header)) + nslots * slot_size;
+
+	// Readers still attached to a segment left by an earlier run keep
+	// their (dead) mapping; new readers get this one.
+	shm_unlink(bus->name);
+	bus->fd = shm_open(bus->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (bus->fd < 0) {
+		perror("shm_open");
+		goto err;
+	}
+	if (ftruncate(bus->fd, bus->size)) {
+		perror("ftruncate");
+		goto err;
+	}
+
+	bus->hdr = mmap(NULL, bus->size, PROT_READ | PROT_WRITE, MAP_SHARED, bus->fd, 0);
+	if (bus->hdr == MAP_FAILED) {
+		bus->hdr = NULL;
+		perror("mmap");
+		goto err;
+	}
+
+	bus->hdr->version = FRAMEBUS_VERSION;
+	bus->hdr->nslots = nslots;
+	bus->hdr->slot_size = slot_size;
+	bus->hdr->raw_width = raw_width;
+	bus->hdr->raw_height = raw_height;
+	bus->hdr->cal_width = cal_width;
+	bus->hdr->cal_height = cal_height;
+	bus->hdr->raw_offset = ROUND_UP_64(sizeof(struct framebus_slot));
+	bus->hdr->cal_offset = bus->hdr->raw_offset + raw_size;
+	bus->hdr->sources_offset = bus->hdr->cal_offset + cal_size;
+	bus->hdr->max_sources = DETECT_MAX_SOURCES;
+	atomic_init(&bus->hdr->head, 0);
+	atomic_thread_fence(memory_order_release);
+	bus->hdr->magic = FRAMEBUS_MAGIC;
+
+	return bus;
+
+err:
+	framebus_close(bus);
+	return NULL;
+}
+
+void
+framebus_publish(FrameBus *bus, const struct cfg_packet *header,
+                 float temperature,
+                 const struct timespec *mono, const struct timespec *utc,
+                 const int16_t *raw, const int16_t *cal,
+                 const struct detect_source *sources, int nsources)
+{
+	struct framebus_header *hdr = bus->hdr;
+	uint32_t frame = atomic_load_explicit(&hdr->head, memory_order_relaxed) + 1;
+	struct framebus_slot *slot = framebus_slot(bus, frame);
+	uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->frame = frame;
+	slot->temperature = temperature;
+	slot->mono_sec = mono->tv_sec;
+	slot->mono_nsec = mono->tv_nsec;
+	slot->utc_sec = utc->tv_sec;
+	slot->utc_nsec = utc->tv_nsec;
+	memcpy(slot->header, header, sizeof slot->header);
+	memcpy((char *)slot + hdr->raw_offset, raw,
+	       hdr->raw_width * hdr->raw_height * sizeof *raw);
+	slot->cal_valid = cal != NULL;
+	if (cal) {
+		memcpy((char *)slot + hdr->cal_offset, cal,
+		       hdr->cal_width * hdr->cal_height * sizeof *cal);
+	}
+	if (nsources > (int)hdr->max_sources) {
+		nsources = hdr->max_sources;
+	}
+	slot->nsources = sources ? nsources : 0;
+	if (slot->nsources) {
+		memcpy((char *)slot + hdr->sources_offset, sources,
+		       slot->nsources * sizeof *sources);
+	}
+
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+	atomic_store_explicit(&hdr->head, frame, memory_order_release);
+
+	syscall(SYS_futex, &hdr->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+FrameBus *
+framebus_attach(const char *name)
+{
+	struct stat st;
+
+	FrameBus *bus = calloc(1, sizeof *bus);
+	if (!bus) {
+		perror("calloc");
+		return NULL;
+	}
+	snprintf(bus->name, sizeof bus->name, "%s", name ? name : FRAMEBUS_NAME);
+
+	bus->fd = shm_open(bus->name, O_RDONLY, 0);
+	if (bus->fd < 0) {
+		perror("shm_open");
+		goto err;
+	}
+	if (fstat(bus->fd, &st)) {
+		perror("fstat");
+		goto err;
+	}
+	bus->size = st.st_size;
+	if (bus->size < sizeof *bus->hdr) {
+		fprintf(stderr, "%s: not a frame bus\n", bus->name);
+		goto err;
+	}
+
+	bus->hdr = mmap(NULL, bus->size, PROT_READ, MAP_SHARED, bus->fd, 0);
+	if (bus->hdr == MAP_FAILED) {
+		bus->hdr = NULL;
+		perror("mmap");
+		goto err;
+	}
+
+	if (bus->hdr->magic != FRAMEBUS_MAGIC || bus->hdr->version != FRAMEBUS_VERSION) {
+		fprintf(stderr, "%s: not a frame bus or wrong version\n", bus->name);
+		goto err;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	return bus;
+
+err:
+	framebus_close(bus);
+	return NULL;
+}
+
+// Point view at the most recently published frame.
+// Returns -1 if nothing was published yet or the slot is being rewritten.
+int
+framebus_latest(FrameBus *bus, struct framebus_view *view)
+{
+	struct framebus_header *hdr = bus->hdr;
+	uint32_t frame = atomic_load_explicit(&hdr->head, memory_order_acquire);
+
+	if (frame == 0)
+		return -1;
+
+	const struct framebus_slot *slot = framebus_slot(bus, frame);
+	view->gen = atomic_load_explicit(&((struct framebus_slot *)slot)->seq, memory_order_acquire);
+	if (view->gen & 1)
+		return -1;
+
+	view->frame = slot->frame;
+	view->slot = slot;
+	view->raw = (const int16_t *)((const char *)slot + hdr->raw_offset);
+	view->cal = slot->cal_valid ? (const int16_t *)((const char *)slot + hdr->cal_offset) : NULL;
+	view->sources = (const struct detect_source *)((const char *)slot + hdr->sources_offset);
+	view->nsources = slot->nsources;
+	if (view->nsources > hdr->max_sources) {
+		view->nsources = 0;	// torn, framebus_check() will fail
+	}
+	return 0;
+}
+
+// Nonzero if the frame behind view was not overwritten since
+// framebus_latest(), i.e. everything read through it is consistent.
+int
+framebus_check(const struct framebus_view *view)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&((struct framebus_slot *)view->slot)->seq,
+	                            memory_order_relaxed) == view->gen;
+}
+
+// Block until a frame newer than last is published, or timeout_ms
+// (negative: forever) passes. Returns 0 if there is a new frame.
+int
+framebus_wait(FrameBus *bus, uint32_t last, int timeout_ms)
+{
+	struct timespec ts, *tsp = NULL;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		tsp = &ts;
+	}
+
+	while (atomic_load_explicit(&bus->hdr->head, memory_order_acquire) == last) {
+		if (syscall(SYS_futex, &bus->hdr->head, FUTEX_WAIT, last, tsp, NULL, 0)
+		 && errno == ETIMEDOUT) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Copy the latest frame out of the bus, retrying if the producer laps
+// the reader. raw and/or cal may be NULL.
+int
+framebus_copy(FrameBus *bus, struct framebus_view *view,
+              int16_t *raw, int16_t *cal)
+{
+	struct framebus_header *hdr = bus->hdr;
+
+	for (int tries = 0; tries < 4; tries++) {
+		if (framebus_latest(bus, view))
+			continue;
+		if (raw) {
+			memcpy(raw, view->raw, hdr->raw_width * hdr->raw_height * sizeof *raw);
+		}
+		if (cal && view->cal) {
+			memcpy(cal, view->cal, hdr->cal_width * hdr->cal_height * sizeof *cal);
+		}
+		if (framebus_check(view))
+			return 0;
+	}
+	return -1;
+}
+
+void
+framebus_close(FrameBus *bus)
+{
+	if (!bus)
+		return;
+
+	if (bus->hdr) {
+		munmap(bus->hdr, bus->size);
+	}
+	if (bus->fd >= 0) {
+		close(bus->fd);
+	}
+	if (bus->owner) {
+		shm_unlink(bus->name);
+	}
+	free(bus);
+}
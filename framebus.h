@@ -0,0 +1,96 @@
+#ifndef FRAMEBUS_H_
+#define FRAMEBUS_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "detect.h"
+
+// Shared-memory ring of the most recent frames, written by astrotherm and
+// read by any number of local processes. Each slot is guarded by a
+// sequence counter (seqlock): the producer makes it odd while writing and
+// even again when done, so readers never lock and never slow the producer;
+// they read in place and then check the counter did not move.
+
+#define FRAMEBUS_NAME    "/astrotherm"
+#define FRAMEBUS_MAGIC   0x42545341	// "ASTB"
+#define FRAMEBUS_VERSION 2
+#define FRAMEBUS_SLOTS   8
+#define FRAMEBUS_HEADER_WORDS 32	// struct cfg_packet as received
+
+struct cfg_packet;
+
+struct framebus_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;
+	uint32_t slot_size;		// bytes per slot
+	uint32_t raw_width;		// full sensor frame
+	uint32_t raw_height;
+	uint32_t cal_width;		// dark subtracted, cropped and binned
+	uint32_t cal_height;
+	uint32_t raw_offset;		// pixel offsets from the start of a slot
+	uint32_t cal_offset;
+	_Atomic uint32_t head;		// number of frames published so far
+	uint32_t sources_offset;	// source list offset from the start of a slot
+	uint32_t max_sources;
+	uint32_t pad[3];
+};
+
+struct framebus_slot {
+	_Atomic uint32_t seq;		// odd while being written
+	uint32_t frame;			// value of head once published
+	uint32_t cal_valid;
+	uint32_t nsources;		// sources found in the calibrated frame
+	float temperature;		// detector, deg C
+	int64_t mono_sec;		// arrival time, CLOCK_MONOTONIC
+	int64_t mono_nsec;
+	int64_t utc_sec;		// arrival time, UTC
+	int64_t utc_nsec;
+	uint16_t header[FRAMEBUS_HEADER_WORDS];
+	// followed by raw and calibrated int16 pixels and the source list
+};
+
+typedef struct framebus {
+	int fd;
+	int owner;			// created (and unlinks) the segment
+	size_t size;
+	char name[64];
+	struct framebus_header *hdr;
+} FrameBus;
+
+// A frame as seen by a reader. The pointers refer into the shared
+// segment; the data are only known to be intact if framebus_check()
+// succeeds after they have been used.
+struct framebus_view {
+	uint32_t frame;
+	uint32_t gen;
+	const struct framebus_slot *slot;
+	const int16_t *raw;
+	const int16_t *cal;		// NULL when not published
+	const struct detect_source *sources;
+	uint32_t nsources;
+};
+
+// Producer
+FrameBus *framebus_create(const char *name, int raw_width, int raw_height,
+                          int cal_width, int cal_height, int nslots);
+void framebus_publish(FrameBus *bus, const struct cfg_packet *header,
+                      float temperature,
+                      const struct timespec *mono, const struct timespec *utc,
+                      const int16_t *raw, const int16_t *cal,
+                      const struct detect_source *sources, int nsources);
+
+// Readers
+FrameBus *framebus_attach(const char *name);
+int framebus_latest(FrameBus *bus, struct framebus_view *view);
+int framebus_wait(FrameBus *bus, uint32_t last, int timeout_ms);
+int framebus_check(const struct framebus_view *view);
+int framebus_copy(FrameBus *bus, struct framebus_view *view,
+                  int16_t *raw, int16_t *cal);
+
+void framebus_close(FrameBus *bus);
+
+#endif /* FRAMEBUS_H_ */
@@ -13,15 +13,21 @@
 #include <ctype.h>
 #include <ncurses.h>
 
-#include "fitsio.h"
 #include <time.h>
 
-#define BUF_LEN 256
+#include "denoise.h"
+#include "pixstat.h"
+#include "bin.h"
+#include "thermfits.h"
+#include "burst.h"
+#include "framebus.h"
+#include "detect.h"
+#include "clahe.h"
+#include "stream.h"
+#include "radiometry.h"
+
 #define NDARKS 11
-#define DETNAM "ThermApp"
-#define WAVELEN "7.5 -14 micron"
-#define PIXSZ 17
-#define FRAMERAT 8.7
+#define DAC_STEP 16
 
 #undef FRAME_RAW
 
@@ -39,16 +45,12 @@
 #define ROUND_UP_64(num) (((num)+63)&~63)
 
 
-//int write_fits_fname(int16_t *frame_arr, char *fname);
-//int write_fits_fname(int16_t *frame_arr, char *fname, char *imgtyp);
-int write_fits_fname(int16_t *frame_arr, char *fname, char *imgtyp, float TempC);
-int get_science_fname(char *opfname);
-int get_dark_fname(char *opfname, int framecount);
 int format_properties(const unsigned int format,
                       const unsigned int width,
                       const unsigned int height,
                       size_t *framesize,
                       size_t *linewidth);
+void usage(void);
 int main(int argc, char *argv[]);
 
 int format_properties(const unsigned int format,
@@ -61,8 +63,10 @@ int format_properties(const unsigned int format,
 	switch (format) {
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
-		lw = width; /* ??? */
-		fs = ROUND_UP_4(width) * ROUND_UP_2(height);
+		// luma rows are padded to a multiple of 4 bytes, so a cropped or
+		// binned width that is not must be written at this stride
+		lw = ROUND_UP_4(width);
+		fs = lw * ROUND_UP_2(height);
 		fs += 2 * ((ROUND_UP_8(width) / 2) * (ROUND_UP_2(height) / 2));
 		break;
 	case V4L2_PIX_FMT_UYVY:
@@ -88,6 +92,30 @@ int format_properties(const unsigned int format,
 	return 0;
 }
 
+void usage(void)
+{
+	printf("Usage: sudo astrotherm [options] /dev/videoX\n"
+	       "  -t          enable temporal (recursive) denoise\n"
+	       "  -a alpha    temporal filter weight of newest frame, 1-256 (default %d)\n"
+	       "  -g counts   temporal filter motion gate (default %d)\n"
+	       "  -m          enable 3x3 median denoise\n"
+	       "  -b N        track hot/flickering pixels using every Nth frame\n"
+	       "  -r x,y,w,h  only keep the w x h region of interest at x,y\n"
+	       "  -x N        bin NxN pixels, N = 1, 2 or 4\n"
+	       "  -k K        keep K frames before a burst trigger, 0 disables (default %d)\n"
+	       "  -p M        save M frames after a burst trigger (default %d)\n"
+	       "  -s name     publish frames to shared memory /dev/shm/name\n"
+	       "  -d sigma    detect sources above sigma x background noise\n"
+	       "  -e          display with adaptive histogram equalization (CLAHE)\n"
+	       "  -c limit    CLAHE clip limit, 1-%g (default %g)\n"
+	       "  -l port     serve raw frames to TCP clients on port (e.g. %d)\n"
+	       "  -u          also serve them over UDP on the same port\n"
+	       "  -R file     radiometric calibration; saved frames get a deg C image too\n"
+	       "  -I          write that image as scaled 16-bit integers, not floats\n",
+	       DENOISE_ALPHA, DENOISE_THRESHOLD, BURST_PRE, BURST_POST,
+	       CLAHE_MAX_CLIP, CLAHE_CLIP, STREAM_PORT);
+}
+
 int main(int argc, char *argv[])
 {
 	int16_t frame[PIXELS_DATA_SIZE];
@@ -95,13 +123,109 @@ int main(int argc, char *argv[])
 	char fnam[BUF_LEN] = {0};
 	float ThermTempC;
 	const char *VIDEO_DEVICE = NULL;
+	int opt;
+	int dn_temporal = 0, dn_median = 0;
+	int dn_alpha = DENOISE_ALPHA, dn_threshold = DENOISE_THRESHOLD;
+	Denoise *dn = NULL;
+	int stat_interval = 0;
+	PixStat *ps = NULL;
+	int roi_x = 0, roi_y = 0, roi_w = FRAME_WIDTH, roi_h = FRAME_HEIGHT;
+	int binfactor = 1;
+	Binning *bn = NULL;
+	int16_t binframe[PIXELS_DATA_SIZE];
+	int burst_pre = BURST_PRE, burst_post = BURST_POST;
+	Burst *burst = NULL;
+	struct timespec frame_utc;
+	const char *bus_name = NULL;
+	FrameBus *bus = NULL;
+	struct cfg_packet frame_hdr;
+	struct timespec frame_mono;
+	float detect_sigma = 0;
+	Detect *dt = NULL;
+	const struct detect_source *sources = NULL;
+	int nsources = 0;
+	int equalize = 0;
+	float clahe_clip = CLAHE_CLIP;
+	Clahe *cl = NULL;
+	int stream_port = 0, stream_udp = 0;
+	Stream *srv = NULL;
+	struct thermapp_frame *tf;
+	const char *rad_file = NULL;
+	int rad_scaled = 0;
+	Radiometry *rad = NULL;
+	char radfnam[BUF_LEN];
+	float radframe[PIXELS_DATA_SIZE];
+	int16_t radscaled[PIXELS_DATA_SIZE];
+	const int16_t *radin = binframe;	// binned counts the conversion uses
+
+	while ((opt = getopt(argc, argv, "ta:g:mb:r:x:k:p:s:d:ec:l:uR:I")) != -1) {
+		switch (opt) {
+		case 't':
+			dn_temporal = 1;
+			break;
+		case 'a':
+			dn_alpha = atoi(optarg);
+			break;
+		case 'g':
+			dn_threshold = atoi(optarg);
+			break;
+		case 'm':
+			dn_median = 1;
+			break;
+		case 'b':
+			stat_interval = atoi(optarg);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%d,%d,%d,%d", &roi_x, &roi_y, &roi_w, &roi_h) != 4) {
+				usage();
+				return 0;
+			}
+			break;
+		case 'x':
+			binfactor = atoi(optarg);
+			break;
+		case 'k':
+			burst_pre = atoi(optarg);
+			break;
+		case 'p':
+			burst_post = atoi(optarg);
+			break;
+		case 's':
+			bus_name = optarg;
+			break;
+		case 'd':
+			detect_sigma = atof(optarg);
+			break;
+		case 'e':
+			equalize = 1;
+			break;
+		case 'c':
+			clahe_clip = atof(optarg);
+			break;
+		case 'l':
+			stream_port = atoi(optarg);
+			break;
+		case 'u':
+			stream_udp = 1;
+			break;
+		case 'R':
+			rad_file = optarg;
+			break;
+		case 'I':
+			rad_scaled = 1;
+			break;
+		default:
+			usage();
+			return 0;
+		}
+	}
 
-	if (argc != 2) {
-		printf("Usage: sudo astrotherm /dev/videoX\n");
+	if (optind != argc - 1) {
+		usage();
 		return 0;
 	}
 
-	VIDEO_DEVICE = argv[1];
+	VIDEO_DEVICE = argv[optind];
 
 	ThermApp *therm = thermapp_open();
 	if (!therm) {
@@ -124,6 +248,54 @@ int main(int argc, char *argv[])
 	printf("Firmware version: %d\n", thermapp_getFirmwareVersion(therm));
 	printf("Temperature: %f\n", ThermTempC);
 
+	bn = bin_open(FRAME_WIDTH, FRAME_HEIGHT, roi_x, roi_y, roi_w, roi_h, binfactor);
+	if (!bn) {
+		ret = EXIT_FAILURE;
+		goto done2;
+	}
+	const int width = bn->width;
+	const int height = bn->height;
+	const int npix = width * height;
+	if (npix != PIXELS_DATA_SIZE) {
+		printf("Output frames: %dx%d\n", width, height);
+	}
+
+	if (bus_name) {
+		char shm_name[BUF_LEN];
+		snprintf(shm_name, sizeof shm_name, "/%s", bus_name + (*bus_name == '/'));
+		bus = framebus_create(shm_name, FRAME_WIDTH, FRAME_HEIGHT,
+		                      width, height, FRAMEBUS_SLOTS);
+		if (!bus) {
+			ret = EXIT_FAILURE;
+			goto done2;
+		}
+	}
+
+	if (rad_file) {
+		rad = radiometry_open(rad_file);
+		if (!rad) {
+			ret = EXIT_FAILURE;
+			goto done2;
+		}
+	}
+
+	if (stream_port > 0) {
+		srv = stream_open(therm, stream_port, stream_udp);
+		if (!srv) {
+			ret = EXIT_FAILURE;
+			goto done2;
+		}
+		printf("Serving frames on port %d%s\n", stream_port, stream_udp ? " (TCP and UDP)" : "");
+	}
+
+	if (burst_pre > 0) {
+		burst = burst_open(bn, burst_pre, burst_post, rad, rad_scaled);
+		if (!burst) {
+			ret = EXIT_FAILURE;
+			goto done2;
+		}
+	}
+
 #ifndef FRAME_RAW
 	int flipv = 0;
 	if (argc >= 2) {
@@ -136,7 +308,48 @@ int main(int argc, char *argv[])
 	double offset_cal = 0;
 	long meancal = 0;
 	int image_cal[PIXELS_DATA_SIZE];
-	int deadpixel_map[PIXELS_DATA_SIZE] = { 0 };
+	uint8_t deadpixel_map[PIXELS_DATA_SIZE] = { 0 };
+	const uint8_t *badmap = deadpixel_map;
+	int nbad = 0;
+	int16_t calframe[PIXELS_DATA_SIZE];
+	int16_t outframe[PIXELS_DATA_SIZE];
+	int16_t radcounts[PIXELS_DATA_SIZE];
+	int16_t radbin[PIXELS_DATA_SIZE];
+	uint8_t luma[PIXELS_DATA_SIZE];
+
+	dn = denoise_open(width, height);
+	if (!dn) {
+		ret = EXIT_FAILURE;
+		goto done2;
+	}
+	dn->temporal = dn_temporal;
+	dn->median = dn_median;
+	if (denoise_set_alpha(dn, dn_alpha)
+	 || denoise_set_threshold(dn, dn_threshold)) {
+		fprintf(stderr, "invalid denoise settings\n");
+		ret = EXIT_FAILURE;
+		goto done2;
+	}
+
+	cl = clahe_open(width, height);
+	if (!cl) {
+		ret = EXIT_FAILURE;
+		goto done2;
+	}
+	if (clahe_set_clip(cl, clahe_clip)) {
+		fprintf(stderr, "invalid CLAHE clip limit\n");
+		ret = EXIT_FAILURE;
+		goto done2;
+	}
+
+	if (detect_sigma > 0) {
+		dt = detect_open(width, height, detect_sigma);
+		if (!dt) {
+			ret = EXIT_FAILURE;
+			goto done2;
+		}
+		sources = dt->sources;
+	}
 
 	memset(image_cal, 0, sizeof image_cal);
 	printf("Calibrating... cover the lens!\n");
@@ -146,7 +359,10 @@ int main(int argc, char *argv[])
 			goto done2;
 		}
 		ret = get_dark_fname(fnam, i);
-		ret = write_fits_fname(frame, fnam, "DARK", ThermTempC);
+		thermapp_getFrameTime(therm, &frame_mono, &frame_utc);
+		bin_apply(bn, frame, binframe);
+		ret = write_fits_fname(binframe, bn, fnam, "DARK", ThermTempC, &frame_utc,
+		                       &frame_mono, NULL, 0);
 
 		printf("\rCaptured calibration frame %d/%d: %s\n", i+1,NDARKS,fnam);
 		fflush(stdout);
@@ -167,6 +383,17 @@ int main(int argc, char *argv[])
 		if ((image_cal[i] > meancal + 250) || (image_cal[i] < meancal - 250)) {
 			//printf("Dead pixel ID: %d (%d vs %li)\n", i, image_cal[i], meancal);
 			deadpixel_map[i] = 1;
+			nbad++;
+		}
+	}
+	printf("Dead pixels: %d\n", nbad);
+	radin = radbin;
+
+	if (stat_interval > 0) {
+		ps = pixstat_open(PIXELS_DATA_SIZE, deadpixel_map, stat_interval);
+		if (!ps) {
+			ret = EXIT_FAILURE;
+			goto done2;
 		}
 	}
 	// end of get cal
@@ -190,8 +417,8 @@ int main(int argc, char *argv[])
 		goto done3;
 	}
 
-	vid_format.fmt.pix.width = FRAME_WIDTH;
-	vid_format.fmt.pix.height = FRAME_HEIGHT;
+	vid_format.fmt.pix.width = width;
+	vid_format.fmt.pix.height = height;
 	vid_format.fmt.pix.pixelformat = FRAME_FORMAT;
 	vid_format.fmt.pix.field = V4L2_FIELD_NONE;
 	vid_format.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
@@ -215,62 +442,209 @@ int main(int argc, char *argv[])
 		goto done3;
 	}
 
+#ifndef FRAME_RAW
+	// Row padding, the padding row of an odd height and the chroma planes
+	// are never written below and stay neutral
+	uint8_t img[PIXELS_DATA_SIZE * 3 / 2];
+	memset(img, 128, sizeof img);
+#endif
+
 	char ch;
 	initscr();
 	nodelay(stdscr, true);
 	noecho();
 
-	while (thermapp_getImage(therm, frame) == 0) {
+	while ((tf = thermapp_acquireFrame(therm)) != NULL) {
+		memcpy(frame, tf->packet->pixels_data, sizeof frame);
+		if (srv) {
+			stream_publish(srv, tf);
+		}
+		thermapp_releaseFrame(therm, tf);
+		bin_apply(bn, frame, binframe);
 #ifndef FRAME_RAW
-		uint8_t img[PIXELS_DATA_SIZE * 3 / 2];
 		int i;
-		int frameMax = ((frame[0] + pre_offset_cal - image_cal[0]) * gain_cal) + offset_cal;
-		int frameMin = ((frame[0] + pre_offset_cal - image_cal[0]) * gain_cal) + offset_cal;
-		for (i = 0; i < PIXELS_DATA_SIZE; i++) { // get the min and max values
-			// only bother if the pixel isn't dead
-			if (!deadpixel_map[i]) {
-				int x = ((frame[i] + pre_offset_cal - image_cal[i]) * gain_cal) + offset_cal;
-				if (x > frameMax) {
-					frameMax = x;
-				}
-				if (x < frameMin) {
-					frameMin = x;
+		// full frame calibration, then crop/bin for everything downstream
+		// dark subtract, patching dead pixels from their left neighbour
+		for (i = 0; i < PIXELS_DATA_SIZE; i++) {
+			int x = ((frame[i] + pre_offset_cal - image_cal[i]) * gain_cal) + offset_cal;
+			if (x > INT16_MAX) x = INT16_MAX;
+			if (x < INT16_MIN) x = INT16_MIN;
+			calframe[i] = x;
+		}
+		// The radiometric model works on absolute counts: remove the fixed
+		// pattern of the darks but keep their mean level, O accounts for it
+		if (rad) {
+			for (i = 0; i < PIXELS_DATA_SIZE; i++) {
+				int x = frame[i] - image_cal[i] + meancal;
+				if (x > INT16_MAX) x = INT16_MAX;
+				if (x < INT16_MIN) x = INT16_MIN;
+				radcounts[i] = x;
+			}
+		}
+		if (ps) {
+			pixstat_feed(ps, calframe);
+			badmap = pixstat_badmap(ps);
+			if (pixstat_nbad(ps) != nbad) {
+				nbad = pixstat_nbad(ps);
+				fprintf(stdout,"Bad pixels: %d\n", nbad);
+			}
+		}
+		for (i = 1; i < PIXELS_DATA_SIZE; i++) {
+			if (badmap[i]) {
+				calframe[i] = calframe[i-1];
+			}
+		}
+
+		bin_apply(bn, calframe, outframe);
+		if (rad) {
+			for (i = 1; i < PIXELS_DATA_SIZE; i++) {
+				if (badmap[i]) {
+					radcounts[i] = radcounts[i-1];
 				}
 			}
+			bin_apply(bn, radcounts, radbin);
 		}
-		// second time through, this time actually scaling data
-		for (i = 0; i < PIXELS_DATA_SIZE; i++) {
-			int x = ((frame[i] + pre_offset_cal - image_cal[i]) * gain_cal) + offset_cal;
-			if (deadpixel_map[i]) {
-				x = ((frame[i-1] + pre_offset_cal - image_cal[i-1]) * gain_cal) + offset_cal;
+		if (dt) {
+			nsources = detect_run(dt, outframe);
+		}
+		if (bus) {
+			thermapp_getHeader(therm, &frame_hdr);
+			thermapp_getFrameTime(therm, &frame_mono, &frame_utc);
+			framebus_publish(bus, &frame_hdr, thermapp_getTemperature(therm),
+			                 &frame_mono, &frame_utc, frame, outframe,
+			                 sources, nsources);
+		}
+		denoise_apply(dn, outframe);
+
+		if (equalize) {
+			clahe_apply(cl, outframe, luma);
+		} else {
+			int frameMax = outframe[0];
+			int frameMin = outframe[0];
+			for (i = 0; i < npix; i++) { // get the min and max values
+				int x = outframe[i];
+				frameMax = x > frameMax ? x : frameMax;
+				frameMin = x < frameMin ? x : frameMin;
 			}
-			x = (((double)x - frameMin)/(frameMax - frameMin)) * (235 - 16) + 16;
+			if (frameMax == frameMin) {
+				frameMax = frameMin + 1;
+			}
+			// second time through, this time actually scaling data
+			for (i = 0; i < npix; i++) {
+				int x = outframe[i];
+				luma[i] = (((double)x - frameMin)/(frameMax - frameMin)) * (235 - 16) + 16;
+			}
+		}
+		for (int y = 0; y < height; y++) {
+			const uint8_t *src = luma + y * width;
 			if (flipv) {
-				img[PIXELS_DATA_SIZE - ((i/FRAME_WIDTH)+1)*FRAME_WIDTH + i%FRAME_WIDTH] = x;
+				memcpy(img + (height - y - 1) * linewidth, src, width);
 			} else {
-				img[((i/FRAME_WIDTH)+1)*FRAME_WIDTH - i%FRAME_WIDTH - 1] = x;
+				uint8_t *dst = img + y * linewidth + width - 1;
+				for (int x = 0; x < width; x++) {
+					dst[-x] = src[x];
+				}
 			}
 		}
-		for (; i < sizeof img; i++) {
-			img[i] = 128;
-		}
-		write(fdwr, img, sizeof img);
+		write(fdwr, img, framesize);
 #else
-		write(fdwr, frame, sizeof frame);
+		if (bus) {
+			thermapp_getHeader(therm, &frame_hdr);
+			thermapp_getFrameTime(therm, &frame_mono, &frame_utc);
+			framebus_publish(bus, &frame_hdr, thermapp_getTemperature(therm),
+			                 &frame_mono, &frame_utc, frame, NULL, NULL, 0);
+		}
+		write(fdwr, binframe, framesize);
 #endif
+		// The one place counts become deg C, for every frame that is
+		// saved: s/S and the burst ring
+		if (rad) {
+			// cheap unless the detector drifted past the threshold
+			radiometry_update(rad, thermapp_getTemperature(therm));
+			if (rad_scaled) {
+				radiometry_apply_scaled(rad, radin, radscaled, npix);
+			} else {
+				radiometry_apply(rad, radin, radframe, npix);
+			}
+		}
+		if (burst && burst_push(burst, therm, binframe,
+		                        rad_scaled ? (void *)radscaled : (void *)radframe)) {
+			fprintf(stdout,"Burst captured, writing...\n");
+		}
 		ch = getch();
 		if (toupper(ch) == 'S') {
 		        ret = get_science_fname(fnam);
 			ThermTempC = thermapp_getTemperature(therm);
-			ret = write_fits_fname(frame, fnam, "SCIENCE", ThermTempC);
-			fprintf(stdout,"Saved %s\n",fnam);
+			thermapp_getFrameTime(therm, &frame_mono, &frame_utc);
+			ret = write_fits_fname(binframe, bn, fnam, "SCIENCE", ThermTempC, &frame_utc,
+			                       &frame_mono, sources, nsources);
+			if (sources) {
+				fprintf(stdout,"Saved %s with %d sources\n",fnam,nsources);
+			} else {
+				fprintf(stdout,"Saved %s\n",fnam);
+			}
+			if (rad) {
+				get_radiometric_fname(radfnam, fnam);
+				ret = write_fits_radiometric(rad_scaled ? (void *)radscaled : (void *)radframe,
+				                             rad_scaled, bn, radfnam, ThermTempC,
+				                             &frame_utc, &frame_mono, rad, rad->lut_temp);
+				fprintf(stdout,"Saved %s (detector %.2f C)\n",radfnam,rad->lut_temp);
+			}
 		}
+		if (ch == '+' || ch == '-') {
+			int gain = thermapp_getGain(therm) + (ch == '+' ? DAC_STEP : -DAC_STEP);
+			if (gain >= 0 && thermapp_setGain(therm, gain) == 0) {
+				fprintf(stdout,"Gain (VoutC): %d\n", gain);
+			}
+		}
+		if (ch == ']' || ch == '[') {
+			int offset = thermapp_getOffset(therm) + (ch == ']' ? DAC_STEP : -DAC_STEP);
+			if (offset >= 0 && thermapp_setOffset(therm, offset) == 0) {
+				fprintf(stdout,"Offset (VoutA): %d\n", offset);
+			}
+		}
+		if (toupper(ch) == 'B') {
+			int bt;
+			if (!burst) {
+				fprintf(stdout,"Burst capture disabled (-k 0)\n");
+			} else if ((bt = burst_trigger(burst)) == -2) {
+				fprintf(stdout,"No frames kept yet, try again\n");
+			} else if (bt) {
+				fprintf(stdout,"Previous burst still in progress\n");
+			} else {
+				fprintf(stdout,"Burst triggered\n");
+			}
+		}
+#ifndef FRAME_RAW
+		if (toupper(ch) == 'T') {
+			dn->temporal = !dn->temporal;
+			denoise_reset(dn);
+			fprintf(stdout,"Temporal denoise %s\n", dn->temporal ? "on" : "off");
+		}
+		if (toupper(ch) == 'M') {
+			dn->median = !dn->median;
+			fprintf(stdout,"Median denoise %s\n", dn->median ? "on" : "off");
+		}
+		if (toupper(ch) == 'E') {
+			equalize = !equalize;
+			fprintf(stdout,"Display %s\n", equalize ? "CLAHE" : "linear stretch");
+		}
+#endif
 		if (toupper(ch) == 'Q') {
 			endwin();
 			printf("User asked to quit.\n");
 			//goto done3;
 			close(fdwr);
+			stream_close(srv);
 			thermapp_close(therm);
+			denoise_close(dn);
+			pixstat_close(ps);
+			burst_close(burst);
+			framebus_close(bus);
+			detect_close(dt);
+			clahe_close(cl);
+			radiometry_close(rad);
+			bin_close(bn);
 			return ret;
 		}
 	}
@@ -278,110 +652,16 @@ int main(int argc, char *argv[])
 done3:
 	close(fdwr);
 done2:
+	stream_close(srv);
 	thermapp_close(therm);
+	denoise_close(dn);
+	pixstat_close(ps);
+	burst_close(burst);
+	framebus_close(bus);
+	detect_close(dt);
+	clahe_close(cl);
+	radiometry_close(rad);
+	bin_close(bn);
 done1:
 	return ret;
 }
-
-
-
-/* This function creates the output file name of a science frame based 
- * on the current UTC */
-int get_science_fname(char *opfname)
-{
-    time_t now = time(&now);
-    
-    if (now == -1) {
-        puts("The time() function failed");
-    }
-        
-    struct tm *ptm = gmtime(&now);
-    
-    if (ptm == NULL) {
-        puts("The gmtime() function failed");
-    }    
-    
-    strftime(opfname, BUF_LEN, "thermapp_%Y%m%d_%H%M%S.fits", ptm);
-    return 0;
-}
-
-/* This function creates the output file name of a dark frame based 
- * on the current UTC and frame counter */
-int get_dark_fname(char *opfname, int framecount)
-{
-    char fc[BUF_LEN];
-    time_t now = time(&now);
-    
-    if (now == -1) {
-        puts("The time() function failed");
-    }
-        
-    struct tm *ptm = gmtime(&now);
-    
-    if (ptm == NULL) {
-        puts("The gmtime() function failed");
-    }    
-    
-    strftime(opfname, BUF_LEN, "thermapp_%Y%m%d_%H%M", ptm);
-
-    sprintf(fc,"_dark%02d.fits",framecount+1);
-    strcat(opfname, fc);
-    return 0;
-}
-
-
-int write_fits_fname(int16_t *frame_arr, char *fname, char *imgtyp, float TempC)
-{
-	int jj;
-	int status = 0;        /* initialize status before calling fitsio  */
-	int bitpix =  16;      /* 16-bit short signed integer pixel values */
-	long fpixel = 1;                           /* first pixel to write */
-	long array[PIXELS_DATA_SIZE];
-	long naxis =   2;                           /* 2-dimensional image */
-	long naxes[2] = {FRAME_WIDTH, FRAME_HEIGHT};
-	int pixsz = PIXSZ;
-	double framerat = FRAMERAT;
-
-	fitsfile *fptr;                        /* pointer to the FITS file */
-	
-	if ( fits_create_file(&fptr, fname, &status) )      /* create FITS */
-		return( status );
-	
-	/* Write the required keywords for the primary array image         */
-	if ( fits_create_img(fptr,  bitpix, naxis, naxes, &status) )
-		return( status );
-	if ( fits_write_date(fptr, &status) )
-		return( status );
-	if ( fits_update_key(fptr, TSTRING, "INSTRUME", &DETNAM, 
-				"Detector", &status) )
-		return ( status );
-	if ( fits_update_key(fptr, TSTRING, "WAVELEN", &WAVELEN, 
-				"Microns", &status) )
-		return ( status );
-	if ( fits_update_key(fptr, TINT, "PIXSZ", &pixsz, 
-				"Pixel size in microns", &status) )
-		return ( status );
-	if ( fits_update_key(fptr, TDOUBLE, "FRAMERAT", &framerat, 
-				"Frame rate in HZ", &status) )
-		return ( status );
-	if ( fits_update_key(fptr, TSTRING, "IMGTYPE", imgtyp, 
-				"Science or Dark image", &status) )
-		return ( status );
-	if ( fits_update_key(fptr, TFLOAT, "DET_TEMP", &TempC, 
-				"Temperature [C]", &status) )
-		return ( status );
-
-	/* Convert int16_t to long */
-	for (jj = 0; jj < PIXELS_DATA_SIZE; jj++)
-		array[jj] = (long)frame_arr[jj];
-			
-	/* Write the array of long ints (after converting to short)        */
-	if ( fits_write_img(fptr, TLONG, fpixel, PIXELS_DATA_SIZE, array, &status) )
-		return( status );
-	fits_close_file(fptr, &status);                  /* close the file */
-	fits_report_error(stderr, status); /* print out any error messages */
-	
-	return status;
-}
-
-
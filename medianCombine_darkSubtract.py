@@ -33,7 +33,8 @@ def median_combine_darks (darkpath):
     '''
     darks = sorted(glob.glob(darkpath + "*dark*.fits"))
     ndarks = len(darks)
-    darkdata = np.zeros((ndarks, 288, 384))
+    # darks may be binned or cropped by astrotherm -x/-r
+    darkdata = np.zeros((ndarks,) + fits.getdata(darks[0], ext=0).shape)
     
     for ii in range(ndarks):
         print('Loading dark: ',darks[ii])
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixstat.h"
+
+static void *pixstat_thread(void *ctx);
+
+PixStat *
+pixstat_open(int npix, const uint8_t *static_map, int interval)
+{
+	int ret;
+
+	PixStat *ps = calloc(1, sizeof *ps);
+	if (!ps) {
+		perror("calloc");
+		return NULL;
+	}
+
+	ps->npix = npix;
+	ps->interval = interval > 0 ? interval : 1;
+	ps->window = PIXSTAT_WINDOW;
+	ps->var_factor = PIXSTAT_VAR_FACTOR;
+	ps->drift = PIXSTAT_DRIFT;
+
+	ps->pending = malloc(npix * sizeof *ps->pending);
+	ps->mean = calloc(npix, sizeof *ps->mean);
+	ps->var = calloc(npix, sizeof *ps->var);
+	ps->ref_mean = calloc(npix, sizeof *ps->ref_mean);
+	ps->scratch = malloc(npix * sizeof *ps->scratch);
+	ps->static_map = malloc(npix);
+	ps->cur = malloc(npix);
+	ps->next = malloc(npix);
+	if (!ps->pending || !ps->mean || !ps->var || !ps->ref_mean
+	 || !ps->scratch || !ps->static_map || !ps->cur || !ps->next) {
+		perror("malloc");
+		pixstat_close(ps);
+		return NULL;
+	}
+
+	memcpy(ps->static_map, static_map, npix);
+	memcpy(ps->cur, static_map, npix);
+	int nbad = 0;
+	for (int i = 0; i < npix; i++) {
+		nbad += static_map[i] != 0;
+	}
+	atomic_init(&ps->ready, 0);
+	atomic_init(&ps->nbad, nbad);
+
+	ps->cond_feed = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+	ps->mutex_feed = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+
+	ret = pthread_create(&ps->pthread_stats, NULL, pixstat_thread, ps);
+	if (ret) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+		pixstat_close(ps);
+		return NULL;
+	}
+	ps->started = 1;
+
+	return ps;
+}
+
+void
+pixstat_close(PixStat *ps)
+{
+	if (!ps)
+		return;
+
+	if (ps->started) {
+		pthread_mutex_lock(&ps->mutex_feed);
+		ps->stop = 1;
+		pthread_cond_signal(&ps->cond_feed);
+		pthread_mutex_unlock(&ps->mutex_feed);
+		pthread_join(ps->pthread_stats, NULL);
+	}
+
+	free(ps->next);
+	free(ps->cur);
+	free(ps->static_map);
+	free(ps->scratch);
+	free(ps->ref_mean);
+	free(ps->var);
+	free(ps->mean);
+	free(ps->pending);
+	free(ps);
+}
+
+// Called from the capture loop with the dark-subtracted frame.
+// Never blocks: if the stats thread is still busy the frame is skipped.
+void
+pixstat_feed(PixStat *ps, const int16_t *frame)
+{
+	if (ps->nfed++ % ps->interval)
+		return;
+
+	if (pthread_mutex_trylock(&ps->mutex_feed))
+		return;
+	if (!ps->have_pending) {
+		memcpy(ps->pending, frame, ps->npix * sizeof *frame);
+		ps->have_pending = 1;
+		pthread_cond_signal(&ps->cond_feed);
+	}
+	pthread_mutex_unlock(&ps->mutex_feed);
+}
+
+// Returns the bad-pixel map to use for the current frame.
+// Must only be called from the capture thread.
+const uint8_t *
+pixstat_badmap(PixStat *ps)
+{
+	if (atomic_load_explicit(&ps->ready, memory_order_acquire)) {
+		uint8_t *tmp = ps->cur;
+		ps->cur = ps->next;
+		ps->next = tmp;
+		atomic_store_explicit(&ps->ready, 0, memory_order_release);
+	}
+	return ps->cur;
+}
+
+int
+pixstat_nbad(PixStat *ps)
+{
+	return atomic_load_explicit(&ps->nbad, memory_order_relaxed);
+}
+
+// With a = 1/n this is the exact cumulative mean and (population)
+// variance; with a fixed it becomes an exponentially weighted one.
+static void
+pixstat_accumulate(PixStat *ps, const int16_t *restrict frame)
+{
+	float *restrict mean = ps->mean;
+	float *restrict var = ps->var;
+	const int n = ps->npix;
+
+	if (ps->n < (uint32_t)ps->window) {
+		ps->n++;
+	}
+	ps->since_eval++;
+	const float a = 1.0f / ps->n;
+	const float b = 1.0f - a;
+	for (int i = 0; i < n; i++) {
+		float d = frame[i] - mean[i];
+		mean[i] += d * a;
+		var[i] = b * (var[i] + a * d * d);
+	}
+}
+
+// Hoare's selection, partially reorders a[]
+static float
+select_median(float *a, int n)
+{
+	int lo = 0, hi = n - 1, k = n / 2;
+
+	while (lo < hi) {
+		float pivot = a[(lo + hi) / 2];
+		int i = lo, j = hi;
+		while (i <= j) {
+			while (a[i] < pivot) i++;
+			while (a[j] > pivot) j--;
+			if (i <= j) {
+				float t = a[i];
+				a[i] = a[j];
+				a[j] = t;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+	return a[k];
+}
+
+static void
+pixstat_evaluate(PixStat *ps)
+{
+	const int n = ps->npix;
+	float *restrict s = ps->scratch;
+	float medvar, meddrift;
+	int nbad = 0;
+
+	ps->since_eval = 0;
+	if (!ps->have_ref) {
+		memcpy(ps->ref_mean, ps->mean, n * sizeof *ps->mean);
+		ps->have_ref = 1;
+	}
+
+	// The capture thread has not yet taken the previous map; try again
+	// after the next window.
+	if (atomic_load_explicit(&ps->ready, memory_order_acquire))
+		return;
+
+	memcpy(s, ps->var, n * sizeof *s);
+	medvar = select_median(s, n);
+
+	for (int i = 0; i < n; i++) {
+		s[i] = ps->mean[i] - ps->ref_mean[i];
+	}
+	meddrift = select_median(s, n);
+
+	const float varlim = medvar * ps->var_factor;
+	uint8_t *restrict map = ps->next;
+	for (int i = 0; i < n; i++) {
+		float var = ps->var[i];
+		float d = ps->mean[i] - ps->ref_mean[i] - meddrift;
+		int drifted = d > ps->drift || d < -ps->drift;
+		map[i] = ps->static_map[i] || var > varlim || drifted;
+		nbad += map[i];
+	}
+
+	atomic_store_explicit(&ps->nbad, nbad, memory_order_relaxed);
+	atomic_store_explicit(&ps->ready, 1, memory_order_release);
+}
+
+static void *
+pixstat_thread(void *ctx)
+{
+	PixStat *ps = (PixStat *)ctx;
+
+	for (;;) {
+		pthread_mutex_lock(&ps->mutex_feed);
+		while (!ps->have_pending && !ps->stop) {
+			pthread_cond_wait(&ps->cond_feed, &ps->mutex_feed);
+		}
+		if (ps->stop) {
+			pthread_mutex_unlock(&ps->mutex_feed);
+			break;
+		}
+		pthread_mutex_unlock(&ps->mutex_feed);
+
+		pixstat_accumulate(ps, ps->pending);
+
+		pthread_mutex_lock(&ps->mutex_feed);
+		ps->have_pending = 0;
+		pthread_mutex_unlock(&ps->mutex_feed);
+
+		if (ps->since_eval >= (uint32_t)ps->window) {
+			pixstat_evaluate(ps);
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef PIXSTAT_H_
+#define PIXSTAT_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Memory of the running statistics in samples, and how many new samples
+// arrive between re-evaluations of the bad-pixel set
+#define PIXSTAT_WINDOW     64
+// Flag a pixel whose temporal variance exceeds this multiple of the median
+#define PIXSTAT_VAR_FACTOR 25.0f
+// Flag a pixel whose mean moved this many counts more than the median pixel
+// since the first window
+#define PIXSTAT_DRIFT      250.0f
+
+typedef struct pixstat {
+	int npix;
+	int interval;        // accumulate every Nth fed frame
+	int window;
+	float var_factor;
+	float drift;
+
+	pthread_t pthread_stats;
+	pthread_mutex_t mutex_feed;
+	pthread_cond_t cond_feed;
+	int started;
+	int stop;
+	int have_pending;    // pending[] holds a frame not yet accumulated
+	int16_t *pending;
+	unsigned int nfed;
+
+	// Running per-pixel mean and variance, one array per moment. The
+	// first window is a plain cumulative (Welford) average; from then on
+	// every sample has weight 1/window, so the statistics never restart
+	// and always cover about the last window samples.
+	uint32_t n;          // samples so far, saturates at window
+	uint32_t since_eval; // samples since the last evaluation
+	float *mean;
+	float *var;
+	float *ref_mean;     // means after the first window, drift reference
+	int have_ref;
+	float *scratch;
+
+	uint8_t *static_map; // dead pixels found at startup, always flagged
+
+	// Bad-pixel maps handed from the stats thread to the capture thread.
+	// The capture thread owns cur; the stats thread fills next and sets
+	// ready, after which the capture thread swaps them on its next frame.
+	uint8_t *cur;
+	uint8_t *next;
+	atomic_int ready;
+	atomic_int nbad;
+} PixStat;
+
+PixStat *pixstat_open(int npix, const uint8_t *static_map, int interval);
+void pixstat_close(PixStat *ps);
+void pixstat_feed(PixStat *ps, const int16_t *frame);
+const uint8_t *pixstat_badmap(PixStat *ps);
+int pixstat_nbad(PixStat *ps);
+
+#endif /* PIXSTAT_H_ */
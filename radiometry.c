@@ -0,0 +1,185 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "radiometry.h"
+
+#define LUT_SIZE 65536
+#define KELVIN   273.15
+
+static const char *param_name[RADIOMETRY_NPARAM] = { "R", "B", "F", "O" };
+
+static int
+radiometry_parse(Radiometry *rad, FILE *f, const char *calfile)
+{
+	char line[256], key[32];
+	double v[3];
+	int have[RADIOMETRY_NPARAM] = {0};
+	int lineno = 0;
+
+	while (fgets(line, sizeof line, f)) {
+		lineno++;
+		char *hash = strchr(line, '#');
+		if (hash) {
+			*hash = '\0';
+		}
+		v[1] = v[2] = 0;
+		int n = sscanf(line, "%31s %lf %lf %lf", key, &v[0], &v[1], &v[2]);
+		if (n <= 0)
+			continue;
+		if (n == 1) {
+			fprintf(stderr, "%s:%d: missing value for %s\n", calfile, lineno, key);
+			return -1;
+		}
+
+		int p;
+		for (p = 0; p < RADIOMETRY_NPARAM; p++) {
+			if (strcmp(key, param_name[p]) == 0)
+				break;
+		}
+		if (p < RADIOMETRY_NPARAM) {
+			memcpy(rad->coef[p], v, sizeof v);
+			have[p] = 1;
+		} else if (strcmp(key, "EMISSIVITY") == 0) {
+			rad->emissivity = v[0];
+		} else if (strcmp(key, "REFLECTED") == 0) {
+			rad->reflected = v[0];
+		} else if (strcmp(key, "THRESHOLD") == 0) {
+			rad->threshold = v[0];
+		} else {
+			fprintf(stderr, "%s:%d: unknown parameter %s\n", calfile, lineno, key);
+			return -1;
+		}
+	}
+
+	if (!have[RADIOMETRY_R] || !have[RADIOMETRY_B]) {
+		fprintf(stderr, "%s: R and B are required\n", calfile);
+		return -1;
+	}
+	if (!(rad->emissivity > 0 && rad->emissivity <= 1)) {
+		fprintf(stderr, "%s: EMISSIVITY must be in (0, 1]\n", calfile);
+		return -1;
+	}
+	if (!(rad->threshold >= 0)) {
+		fprintf(stderr, "%s: THRESHOLD must not be negative\n", calfile);
+		return -1;
+	}
+	return 0;
+}
+
+Radiometry *
+radiometry_open(const char *calfile)
+{
+	Radiometry *rad = calloc(1, sizeof *rad);
+	if (!rad) {
+		perror("calloc");
+		return NULL;
+	}
+
+	const char *base = strrchr(calfile, '/');
+	snprintf(rad->calfile, sizeof rad->calfile, "%s", base ? base + 1 : calfile);
+	rad->coef[RADIOMETRY_F][0] = 1;
+	rad->emissivity = 1;
+	rad->reflected = RADIOMETRY_REFLECTED;
+	rad->threshold = RADIOMETRY_THRESHOLD;
+
+	FILE *f = fopen(calfile, "r");
+	if (!f) {
+		perror(calfile);
+		goto err;
+	}
+	int ret = radiometry_parse(rad, f, calfile);
+	fclose(f);
+	if (ret)
+		goto err;
+
+	rad->lut = malloc(LUT_SIZE * sizeof *rad->lut);
+	rad->lut_scaled = malloc(LUT_SIZE * sizeof *rad->lut_scaled);
+	if (!rad->lut || !rad->lut_scaled) {
+		perror("malloc");
+		goto err;
+	}
+
+	return rad;
+
+err:
+	radiometry_close(rad);
+	return NULL;
+}
+
+void
+radiometry_close(Radiometry *rad)
+{
+	if (!rad)
+		return;
+
+	free(rad->lut_scaled);
+	free(rad->lut);
+	free(rad);
+}
+
+static double
+radiometry_param(const Radiometry *rad, int p, double td)
+{
+	return rad->coef[p][0] + (rad->coef[p][1] + rad->coef[p][2] * td) * td;
+}
+
+// Rebuild the lookup tables if the detector temperature moved past the
+// threshold since they were built. Returns 1 if they were rebuilt.
+int
+radiometry_update(Radiometry *rad, float det_temp)
+{
+	if (rad->valid && fabsf(det_temp - rad->lut_temp) <= rad->threshold)
+		return 0;
+
+	const double R = radiometry_param(rad, RADIOMETRY_R, det_temp);
+	const double B = radiometry_param(rad, RADIOMETRY_B, det_temp);
+	const double F = radiometry_param(rad, RADIOMETRY_F, det_temp);
+	const double O = radiometry_param(rad, RADIOMETRY_O, det_temp);
+	const double e = rad->emissivity;
+	// Signal of the reflected surroundings, above the offset
+	const double refl = R / (exp(B / (rad->reflected + KELVIN)) - F);
+
+	for (int i = 0; i < LUT_SIZE; i++) {
+		double signal = ((int16_t)i - O - (1 - e) * refl) / e;
+		double arg = R / signal + F;
+		double t = NAN;
+
+		if (signal > 0 && arg > 1) {
+			t = B / log(arg) - KELVIN;
+		}
+		rad->lut[i] = t;
+
+		double s = (t - RADIOMETRY_BZERO) / RADIOMETRY_BSCALE;
+		if (!(s >= INT16_MIN + 1 && s <= INT16_MAX)) {
+			rad->lut_scaled[i] = RADIOMETRY_BLANK;
+		} else {
+			rad->lut_scaled[i] = lrint(s);
+		}
+	}
+
+	rad->lut_temp = det_temp;
+	rad->valid = 1;
+	return 1;
+}
+
+void
+radiometry_apply(const Radiometry *rad, const int16_t *counts, float *temp, int npix)
+{
+	const float *restrict lut = rad->lut;
+
+	for (int i = 0; i < npix; i++) {
+		temp[i] = lut[(uint16_t)counts[i]];
+	}
+}
+
+void
+radiometry_apply_scaled(const Radiometry *rad, const int16_t *counts, int16_t *temp, int npix)
+{
+	const int16_t *restrict lut = rad->lut_scaled;
+
+	for (int i = 0; i < npix; i++) {
+		temp[i] = lut[(uint16_t)counts[i]];
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef RADIOMETRY_H_
+#define RADIOMETRY_H_
+
+#include <stdint.h>
+
+// Counts to scene temperature. The camera signal follows the usual
+// radiometric model
+//
+//     counts = R / (exp(B / T) - F) + O         T in kelvin
+//
+// blended with the reflected surroundings through the emissivity. R, B,
+// F and O drift with the detector temperature Td, each is a quadratic
+// c0 + c1*Td + c2*Td^2 (Td in deg C). The calibration file has one
+// parameter per line, "#" starts a comment:
+//
+//     R          c0 [c1 [c2]]
+//     B          c0 [c1 [c2]]
+//     F          c0 [c1 [c2]]      default 1
+//     O          c0 [c1 [c2]]      default 0
+//     EMISSIVITY e                 default 1
+//     REFLECTED  deg C             default 20
+//     THRESHOLD  deg C             detector drift that rebuilds the LUT
+//
+// Evaluating that per pixel is too slow for every frame, so it is done
+// once for each of the 65536 possible counts into a lookup table, which
+// is rebuilt only when the detector temperature has moved by more than
+// the threshold since it was built.
+
+#define RADIOMETRY_THRESHOLD 0.1f	// deg C
+#define RADIOMETRY_REFLECTED 20.0	// deg C
+#define RADIOMETRY_BSCALE    0.01	// scaled output: deg C per unit
+#define RADIOMETRY_BZERO     0.0
+#define RADIOMETRY_BLANK     INT16_MIN	// scaled output: no valid temperature
+
+enum { RADIOMETRY_R, RADIOMETRY_B, RADIOMETRY_F, RADIOMETRY_O, RADIOMETRY_NPARAM };
+
+typedef struct radiometry {
+	char calfile[64];		// base name, for the FITS header
+	double coef[RADIOMETRY_NPARAM][3];
+	double emissivity;
+	double reflected;		// deg C
+	float threshold;
+
+	int valid;			// lut built
+	float lut_temp;			// detector temperature of the lut
+	float *lut;			// counts -> deg C, NAN if out of model
+	int16_t *lut_scaled;		// same, in RADIOMETRY_BSCALE units
+} Radiometry;
+
+Radiometry *radiometry_open(const char *calfile);
+void radiometry_close(Radiometry *rad);
+int radiometry_update(Radiometry *rad, float det_temp);
+void radiometry_apply(const Radiometry *rad, const int16_t *counts, float *temp, int npix);
+void radiometry_apply_scaled(const Radiometry *rad, const int16_t *counts, int16_t *temp, int npix);
+
+#endif /* RADIOMETRY_H_ */
@@ -0,0 +1,25 @@
+# Build the thermapp Python module:  python3 setup.py build_ext --inplace
+import subprocess
+from setuptools import setup, Extension
+
+
+def pkgconfig(flag, pkg):
+    out = subprocess.check_output(["pkg-config", flag, pkg], text=True)
+    return [tok[2:] for tok in out.split()]
+
+
+thermapp = Extension(
+    "thermapp",
+    sources=["thermappmodule.c", "thermapp.c"],
+    include_dirs=pkgconfig("--cflags-only-I", "libusb-1.0"),
+    library_dirs=pkgconfig("--libs-only-L", "libusb-1.0"),
+    libraries=pkgconfig("--libs-only-l", "libusb-1.0") + ["pthread"],
+    extra_compile_args=["-O2", "-ftree-vectorize"],
+)
+
+setup(
+    name="thermapp",
+    version="0.1",
+    description="Zero-copy access to the Therm-App camera stream",
+    ext_modules=[thermapp],
+)
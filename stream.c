@@ -0,0 +1,685 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "stream.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+_Static_assert(sizeof(struct stream_header) == 56, "stream_header layout changed");
+_Static_assert(sizeof(struct stream_datagram) == 16, "stream_datagram layout changed");
+
+#define STREAM_FRAME_SIZE (sizeof(struct stream_header) + sizeof(struct thermapp_packet))
+
+// Point at most two iovecs at bytes [off, off + len) of a frame as sent:
+// the stream header followed by the packet in the pool buffer.
+static int
+stream_iov(struct stream_item *item, size_t off, size_t len, struct iovec *iov)
+{
+	int n = 0;
+
+	if (off < sizeof item->hdr) {
+		size_t l = sizeof item->hdr - off;
+		l = l < len ? l : len;
+		iov[n].iov_base = (char *)&item->hdr + off;
+		iov[n++].iov_len = l;
+		off += l;
+		len -= l;
+	}
+	if (len) {
+		iov[n].iov_base = (char *)item->frame->packet + (off - sizeof item->hdr);
+		iov[n++].iov_len = len;
+	}
+	return n;
+}
+
+static void
+stream_unref(Stream *st, struct stream_item *item)
+{
+	if (--item->refs == 0) {
+		thermapp_releaseFrame(st->therm, item->frame);
+		item->frame = NULL;
+	}
+}
+
+// Give back the sent frames the kernel no longer reads from. A frame is
+// done once all zerocopy sends up to its last one have completed; frames
+// sent without zerocopy only wait for the zerocopy sends before them.
+static void
+stream_retire(Stream *st, struct stream_client *c)
+{
+	while (c->head != c->sent) {
+		unsigned int q = c->head % STREAM_QUEUE;
+		if ((int32_t)(c->zc_done - c->last_zc[q]) <= 0)
+			break;
+		stream_unref(st, c->item[q]);
+		c->head++;
+	}
+}
+
+// Frames in flight: sent or partly sent, and not yet retired
+static unsigned int
+stream_inflight(struct stream_client *c)
+{
+	return c->sent - c->head + (c->off != 0);
+}
+
+// Unsent frames are given back right away. The kernel may still read
+// the sent ones, so the client moves to the closing list until their
+// completions are in.
+static void
+stream_drop_client(Stream *st, int i)
+{
+	struct stream_client *c = &st->clients[i];
+
+	if (c->off) {
+		c->sent++;
+		c->off = 0;
+	}
+	while (c->tail != c->sent) {
+		stream_unref(st, c->item[--c->tail % STREAM_QUEUE]);
+	}
+	stream_retire(st, c);
+
+	if (c->head == c->sent) {
+		close(c->fd);
+	} else {
+		shutdown(c->fd, SHUT_RDWR);
+		clock_gettime(CLOCK_MONOTONIC, &c->deadline);
+		c->deadline.tv_sec += STREAM_CLOSE_TIMEOUT;
+		st->closing[st->nclosing++] = *c;
+	}
+	st->clients[i] = st->clients[--st->nclients];
+}
+
+// Close a disconnected client. Without force only once all its frames
+// are retired; with force the connection is reset, which drops whatever
+// the kernel still had queued, and the frames are given back regardless.
+static int
+stream_finish_closing(Stream *st, int i, int force)
+{
+	struct stream_client *c = &st->closing[i];
+
+	stream_retire(st, c);
+	if (c->head != c->sent) {
+		if (!force)
+			return 0;
+		struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+		setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+	}
+	close(c->fd);
+	for (; c->head != c->sent; c->head++) {
+		stream_unref(st, c->item[c->head % STREAM_QUEUE]);
+	}
+	st->closing[i] = st->closing[--st->nclosing];
+	return 1;
+}
+
+static void
+stream_accept(Stream *st)
+{
+	int one = 1, sndbuf = STREAM_SNDBUF;
+	int fd = accept4(st->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("accept4");
+		}
+		return;
+	}
+	if (st->nclients + st->nclosing == STREAM_MAX_CLIENTS) {
+		fprintf(stderr, "stream: too many clients\n");
+		close(fd);
+		return;
+	}
+
+	struct stream_client *c = &st->clients[st->nclients++];
+	memset(c, 0, sizeof *c);
+	c->fd = fd;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+	// Without zerocopy support frames are still sent without a staging
+	// copy, the kernel just copies them into the socket buffer.
+	c->zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) == 0;
+}
+
+// Mark zerocopy sends lo..hi as completed. Completions normally arrive
+// in order, possibly merged into one range, but a range past zc_done is
+// kept until the sends before it have completed too.
+static int
+stream_zc_complete(struct stream_client *c, uint32_t lo, uint32_t hi)
+{
+	if ((int32_t)(hi - lo) < 0 || (int32_t)(c->zc_next - hi) <= 0) {
+		fprintf(stderr, "stream: bogus zerocopy completion %u-%u\n", lo, hi);
+		return -1;
+	}
+	if ((int32_t)(hi + 1 - c->zc_done) <= 0)
+		return 0;
+	if ((int32_t)(lo - c->zc_done) > 0) {
+		if (c->nranges == STREAM_ZC_RANGES) {
+			fprintf(stderr, "stream: too many zerocopy completions out of order\n");
+			return -1;
+		}
+		c->zc_range[c->nranges].lo = lo;
+		c->zc_range[c->nranges++].hi = hi;
+		return 0;
+	}
+
+	c->zc_done = hi + 1;
+	for (int i = 0; i < c->nranges; ) {
+		struct stream_zc_range *r = &c->zc_range[i];
+		if ((int32_t)(r->lo - c->zc_done) > 0) {
+			i++;
+			continue;
+		}
+		if ((int32_t)(r->hi + 1 - c->zc_done) > 0) {
+			c->zc_done = r->hi + 1;
+		}
+		*r = c->zc_range[--c->nranges];
+		i = 0;
+	}
+	return 0;
+}
+
+// Collect zerocopy completions: once the kernel is done with a send its
+// frame may go back to the camera.
+static int
+stream_completions(struct stream_client *c)
+{
+	char control[128];
+	struct msghdr msg = {0};
+
+	for (;;) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+		if (recvmsg(c->fd, &msg, MSG_ERRQUEUE) < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+			 && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+				continue;
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			// The kernel copied the data anyway (e.g. loopback), so
+			// zerocopy only adds the completions: send normally.
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				c->zerocopy = 0;
+			}
+			if (stream_zc_complete(c, serr->ee_info, serr->ee_data))
+				return -1;
+		}
+	}
+}
+
+// Send as much of the client's queue as the socket takes and give back
+// the frames the kernel no longer needs. Returns -1 if the client is gone.
+static int
+stream_flush_client(Stream *st, struct stream_client *c)
+{
+	int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (c->zerocopy ? MSG_ZEROCOPY : 0);
+
+	stream_retire(st, c);
+	while (c->sent != c->tail) {
+		// Start a new frame only while few enough are in flight
+		if (!c->off && stream_inflight(c) >= STREAM_MAX_INFLIGHT)
+			break;
+
+		struct stream_item *item = c->item[c->sent % STREAM_QUEUE];
+		struct iovec iov[2];
+		struct msghdr msg = {0};
+
+		msg.msg_iov = iov;
+		msg.msg_iovlen = stream_iov(item, c->off, STREAM_FRAME_SIZE - c->off, iov);
+		ssize_t n = sendmsg(c->fd, &msg, flags);
+		if (n < 0) {
+			// ENOBUFS: out of optmem for zerocopy, wait for completions
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+				break;
+			return -1;
+		}
+		if (flags & MSG_ZEROCOPY) {
+			c->zc_next++;
+		}
+		c->last_zc[c->sent % STREAM_QUEUE] = c->zc_next - 1;
+		c->off += n;
+		if (c->off == STREAM_FRAME_SIZE) {
+			c->off = 0;
+			c->sent++;
+		}
+	}
+
+	stream_retire(st, c);
+	return 0;
+}
+
+// The kernel has not finished with a frame sent STREAM_MAX_LAG frames ago
+static int
+stream_lagging(Stream *st, struct stream_client *c)
+{
+	if (!stream_inflight(c))
+		return 0;
+	uint32_t oldest = c->item[c->head % STREAM_QUEUE]->hdr.frame;
+	return atomic_load(&st->frame) - oldest > STREAM_MAX_LAG;
+}
+
+static void
+stream_subscribe(Stream *st)
+{
+	char buf[64];
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+	struct timespec now;
+	int i;
+
+	if (recvfrom(st->udp_fd, buf, sizeof buf, MSG_DONTWAIT,
+	             (struct sockaddr *)&addr, &len) < 0 || len != sizeof addr)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < st->nsubs; i++) {
+		if (st->subs[i].addr.sin_addr.s_addr == addr.sin_addr.s_addr
+		 && st->subs[i].addr.sin_port == addr.sin_port)
+			break;
+	}
+	if (i == st->nsubs) {
+		if (st->nsubs == STREAM_MAX_CLIENTS) {
+			fprintf(stderr, "stream: too many UDP subscribers\n");
+			return;
+		}
+		st->subs[st->nsubs++].addr = addr;
+	}
+	st->subs[i].seen = now;
+}
+
+// Send the queued frames to every UDP subscriber, one sendmmsg() batch
+// per frame and subscriber. A full socket buffer loses the rest of the
+// frame for that subscriber, which it sees as a seq gap.
+static void
+stream_flush_udp(Stream *st)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = 0; i < st->nsubs; ) {
+		if (now.tv_sec - st->subs[i].seen.tv_sec > STREAM_UDP_TIMEOUT) {
+			st->subs[i] = st->subs[--st->nsubs];
+		} else {
+			i++;
+		}
+	}
+
+	for (; st->udp_head != st->udp_tail; st->udp_head++) {
+		struct stream_item *item = st->udp_item[st->udp_head % STREAM_QUEUE];
+
+		for (int k = 0; k < st->nchunks; k++) {
+			size_t off = (size_t)k * STREAM_UDP_CHUNK;
+			size_t len = STREAM_FRAME_SIZE - off;
+			struct stream_datagram *dg = &st->chunk_hdr[k];
+
+			dg->magic = STREAM_MAGIC;
+			dg->seq = st->udp_seq + k;
+			dg->frame = item->hdr.frame;
+			dg->chunk = k;
+			dg->nchunks = st->nchunks;
+			st->chunk_iov[3 * k].iov_base = dg;
+			st->chunk_iov[3 * k].iov_len = sizeof *dg;
+			st->chunk_msg[k].msg_hdr.msg_iov = &st->chunk_iov[3 * k];
+			st->chunk_msg[k].msg_hdr.msg_iovlen = 1 + stream_iov(item, off,
+				len < STREAM_UDP_CHUNK ? len : STREAM_UDP_CHUNK,
+				&st->chunk_iov[3 * k + 1]);
+		}
+		st->udp_seq += st->nchunks;
+
+		for (int i = 0; i < st->nsubs; i++) {
+			for (int k = 0; k < st->nchunks; k++) {
+				st->chunk_msg[k].msg_hdr.msg_name = &st->subs[i].addr;
+				st->chunk_msg[k].msg_hdr.msg_namelen = sizeof st->subs[i].addr;
+			}
+			for (int k = 0; k < st->nchunks; ) {
+				int n = sendmmsg(st->udp_fd, &st->chunk_msg[k], st->nchunks - k, MSG_DONTWAIT);
+				if (n <= 0)
+					break;
+				k += n;
+			}
+		}
+		stream_unref(st, item);
+	}
+}
+
+// Collect the completions of disconnected clients and close those that
+// are done, or past their deadline. Their sockets are not polled (a shut
+// down socket always reports POLLHUP); this runs at least every
+// STREAM_CLOSE_POLL_MS while any are left.
+static void
+stream_reap_closing(Stream *st)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = st->nclosing - 1; i >= 0; i--) {
+		struct stream_client *c = &st->closing[i];
+		int force = stream_completions(c)
+		         || now.tv_sec > c->deadline.tv_sec
+		         || (now.tv_sec == c->deadline.tv_sec && now.tv_nsec >= c->deadline.tv_nsec);
+		stream_finish_closing(st, i, force);
+	}
+}
+
+static void *
+stream_thread(void *ctx)
+{
+	Stream *st = ctx;
+	struct pollfd pfd[3 + STREAM_MAX_CLIENTS];
+
+	pthread_mutex_lock(&st->mutex);
+	while (!st->stopping) {
+		int n = 0;
+		pfd[n].fd = st->wake_fd;
+		pfd[n++].events = POLLIN;
+		pfd[n].fd = st->listen_fd;
+		pfd[n++].events = POLLIN;
+		pfd[n].fd = st->udp_fd;		// ignored by poll() when -1
+		pfd[n++].events = POLLIN;
+		for (int i = 0; i < st->nclients; i++) {
+			struct stream_client *c = &st->clients[i];
+			pfd[n].fd = c->fd;
+			int more = c->sent != c->tail
+			        && (c->off || stream_inflight(c) < STREAM_MAX_INFLIGHT);
+			pfd[n++].events = POLLIN | (more ? POLLOUT : 0);
+		}
+		int nclients = st->nclients;
+
+		int timeout = st->nclosing ? STREAM_CLOSE_POLL_MS : 1000;
+
+		pthread_mutex_unlock(&st->mutex);
+		if (poll(pfd, n, timeout) < 0 && errno != EINTR) {
+			perror("poll");
+			pthread_mutex_lock(&st->mutex);
+			break;
+		}
+		pthread_mutex_lock(&st->mutex);
+
+		if (pfd[0].revents & POLLIN) {
+			uint64_t v;
+			if (read(st->wake_fd, &v, sizeof v) < 0) { /* nothing pending */ }
+		}
+		if (pfd[1].revents & POLLIN) {
+			stream_accept(st);
+		}
+		if (pfd[2].revents & POLLIN) {
+			stream_subscribe(st);
+		}
+
+		// Clients accepted above are not in pfd yet; dropping a client
+		// moves the last one into its place, so walk backwards.
+		for (int i = nclients - 1; i >= 0; i--) {
+			struct stream_client *c = &st->clients[i];
+			short ev = pfd[3 + i].revents;
+			int gone = 0;
+
+			if (ev & POLLERR) {
+				gone |= stream_completions(c);
+			}
+			if (ev & (POLLIN | POLLHUP)) {
+				char buf[256];
+				ssize_t r = recv(c->fd, buf, sizeof buf, MSG_DONTWAIT);
+				gone |= r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+			}
+			if (!gone && stream_lagging(st, c)) {
+				fprintf(stderr, "stream: client more than %d frames behind, disconnecting\n",
+				        STREAM_MAX_LAG);
+				gone = 1;
+			}
+			if (gone || stream_flush_client(st, c)) {
+				stream_drop_client(st, i);
+			}
+		}
+		for (int i = nclients; i < st->nclients; i++) {
+			stream_flush_client(st, &st->clients[i]);
+		}
+		stream_reap_closing(st);
+		if (st->udp_fd >= 0) {
+			stream_flush_udp(st);
+		}
+	}
+	pthread_mutex_unlock(&st->mutex);
+
+	return NULL;
+}
+
+// Out of items: take back every frame that is queued but not yet being
+// sent. Frames the kernel is still sending from stay pinned.
+static struct stream_item *
+stream_reclaim(Stream *st)
+{
+	for (int i = 0; i < st->nclients; i++) {
+		struct stream_client *c = &st->clients[i];
+		unsigned int keep = c->sent + (c->off != 0);
+		while ((int)(c->tail - keep) > 0) {
+			stream_unref(st, c->item[--c->tail % STREAM_QUEUE]);
+			c->dropped++;
+		}
+	}
+	for (int i = 0; i < STREAM_MAX_HELD; i++) {
+		if (st->items[i].refs == 0)
+			return &st->items[i];
+	}
+	return NULL;
+}
+
+// Called on the capture thread with a frame it holds; the server takes
+// its own reference for as long as any subscriber still needs the frame.
+void
+stream_publish(Stream *st, struct thermapp_frame *frame)
+{
+	struct stream_item *item = NULL;
+	uint64_t one = 1;
+	uint32_t nframe = atomic_fetch_add(&st->frame, 1) + 1;
+
+	// Never wait for the server thread, skip the frame instead
+	if (pthread_mutex_trylock(&st->mutex)) {
+		atomic_fetch_add(&st->busy, 1);
+		return;
+	}
+
+	for (int i = 0; i < STREAM_MAX_HELD; i++) {
+		if (st->items[i].refs == 0) {
+			item = &st->items[i];
+			break;
+		}
+	}
+	if (!item && (st->nclients || st->nsubs)) {
+		item = stream_reclaim(st);
+	}
+	if (!item || (!st->nclients && !st->nsubs)) {
+		pthread_mutex_unlock(&st->mutex);
+		return;
+	}
+
+	item->frame = frame;
+	item->hdr.magic = STREAM_MAGIC;
+	item->hdr.version = STREAM_VERSION;
+	item->hdr.size = sizeof item->hdr;
+	item->hdr.frame = nframe;
+	item->hdr.width = FRAME_WIDTH;
+	item->hdr.height = FRAME_HEIGHT;
+	item->hdr.packet_size = sizeof *frame->packet;
+	item->hdr.temperature = thermapp_getFrameTemperature(frame);
+	item->hdr.mono_sec = frame->mono.tv_sec;
+	item->hdr.mono_nsec = frame->mono.tv_nsec;
+	item->hdr.utc_sec = frame->utc.tv_sec;
+	item->hdr.utc_nsec = frame->utc.tv_nsec;
+
+	for (int i = 0; i < st->nclients; i++) {
+		struct stream_client *c = &st->clients[i];
+		if (c->tail - c->head == STREAM_QUEUE) {
+			c->dropped++;
+			continue;
+		}
+		c->item[c->tail++ % STREAM_QUEUE] = item;
+		item->refs++;
+	}
+	if (st->nsubs && st->udp_tail - st->udp_head < STREAM_QUEUE) {
+		st->udp_item[st->udp_tail++ % STREAM_QUEUE] = item;
+		item->refs++;
+	}
+	if (item->refs) {
+		thermapp_refFrame(st->therm, frame);
+		if (write(st->wake_fd, &one, sizeof one) < 0) {
+			perror("write");
+		}
+	}
+
+	pthread_mutex_unlock(&st->mutex);
+}
+
+static int
+stream_socket(int type, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+
+	int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof addr)) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+Stream *
+stream_open(ThermApp *therm, int port, int udp)
+{
+	Stream *st = calloc(1, sizeof *st);
+	if (!st) {
+		perror("calloc");
+		return NULL;
+	}
+	st->therm = therm;
+	st->listen_fd = -1;
+	st->udp_fd = -1;
+	st->wake_fd = -1;
+	pthread_mutex_init(&st->mutex, NULL);
+
+	st->nchunks = (STREAM_FRAME_SIZE + STREAM_UDP_CHUNK - 1) / STREAM_UDP_CHUNK;
+	st->chunk_hdr = calloc(st->nchunks, sizeof *st->chunk_hdr);
+	st->chunk_iov = calloc(3 * st->nchunks, sizeof *st->chunk_iov);
+	st->chunk_msg = calloc(st->nchunks, sizeof *st->chunk_msg);
+	if (!st->chunk_hdr || !st->chunk_iov || !st->chunk_msg) {
+		perror("calloc");
+		goto err;
+	}
+
+	st->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (st->wake_fd < 0) {
+		perror("eventfd");
+		goto err;
+	}
+
+	st->listen_fd = stream_socket(SOCK_STREAM, port);
+	if (st->listen_fd < 0)
+		goto err;
+	if (listen(st->listen_fd, STREAM_MAX_CLIENTS)) {
+		perror("listen");
+		goto err;
+	}
+
+	if (udp) {
+		int sndbuf = STREAM_SNDBUF;
+		st->udp_fd = stream_socket(SOCK_DGRAM, port);
+		if (st->udp_fd < 0)
+			goto err;
+		setsockopt(st->udp_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+	}
+
+	int ret = pthread_create(&st->thread, NULL, stream_thread, st);
+	if (ret) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+		goto err;
+	}
+	st->started = 1;
+
+	return st;
+
+err:
+	stream_close(st);
+	return NULL;
+}
+
+// Must be called before thermapp_close(), queued frames are handed back.
+void
+stream_close(Stream *st)
+{
+	uint64_t one = 1;
+
+	if (!st)
+		return;
+
+	if (st->started) {
+		pthread_mutex_lock(&st->mutex);
+		st->stopping = 1;
+		pthread_mutex_unlock(&st->mutex);
+		if (write(st->wake_fd, &one, sizeof one) < 0) {
+			perror("write");
+		}
+		pthread_join(st->thread, NULL);
+	}
+
+	while (st->nclients) {
+		stream_drop_client(st, st->nclients - 1);
+	}
+	// Bounded by STREAM_CLOSE_TIMEOUT
+	while (st->nclosing) {
+		stream_reap_closing(st);
+		if (st->nclosing) {
+			poll(NULL, 0, STREAM_CLOSE_POLL_MS);
+		}
+	}
+	for (; st->udp_head != st->udp_tail; st->udp_head++) {
+		stream_unref(st, st->udp_item[st->udp_head % STREAM_QUEUE]);
+	}
+
+	if (st->udp_fd >= 0) {
+		close(st->udp_fd);
+	}
+	if (st->listen_fd >= 0) {
+		close(st->listen_fd);
+	}
+	if (st->wake_fd >= 0) {
+		close(st->wake_fd);
+	}
+	free(st->chunk_msg);
+	free(st->chunk_iov);
+	free(st->chunk_hdr);
+	pthread_mutex_destroy(&st->mutex);
+	free(st);
+}
@@ -0,0 +1,155 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "thermapp.h"
+
+// Network frame server. Every frame is sent as a struct stream_header
+// followed by the struct thermapp_packet (camera header and raw 16-bit
+// pixels) exactly as received from USB, in host byte order.
+//
+// TCP subscribers get the bytes as a stream, sent with MSG_ZEROCOPY
+// straight from the pooled USB buffers. Each client has its own short
+// queue; a client that falls behind loses frames (the header's frame
+// number skips) instead of holding up the camera. At most
+// STREAM_MAX_INFLIGHT frames per client wait for the kernel to finish
+// sending them, and a client whose oldest such frame is more than
+// STREAM_MAX_LAG frames old is disconnected. A disconnected client's
+// frames stay pinned until the kernel reports them done, or for at most
+// STREAM_CLOSE_TIMEOUT seconds after which the connection is reset.
+//
+// UDP subscribers announce themselves by sending any datagram to the
+// same port, at least every STREAM_UDP_TIMEOUT seconds. Each frame is cut
+// into datagrams of a struct stream_datagram and up to STREAM_UDP_CHUNK
+// payload bytes; seq counts every datagram sent, so gaps show losses.
+
+#define STREAM_PORT          5005
+#define STREAM_MAGIC         0x4d525453	// "STRM"
+#define STREAM_VERSION       1
+#define STREAM_QUEUE         4		// frames queued per client
+#define STREAM_MAX_CLIENTS   8		// TCP clients, and UDP subscribers
+#define STREAM_UDP_CHUNK     1440	// payload bytes per datagram
+#define STREAM_UDP_TIMEOUT   10
+#define STREAM_SNDBUF        (1 << 20)
+#define STREAM_MAX_INFLIGHT  1		// frames per client the kernel may read
+#define STREAM_MAX_LAG       16		// frames, about 2 s
+#define STREAM_CLOSE_TIMEOUT 2
+#define STREAM_CLOSE_POLL_MS 50
+#define STREAM_ZC_RANGES     8		// completions held out of order
+// Frames held at once, leaving the camera enough pool buffers to keep
+// receiving while the slowest client catches up. Queued frames that are
+// not yet sent can be taken back, those in flight cannot, so every
+// client pinning its maximum must still leave items to queue new frames.
+#define STREAM_MAX_HELD      (THERMAPP_POOL_SIZE - 4)
+_Static_assert(STREAM_MAX_CLIENTS * STREAM_MAX_INFLIGHT < STREAM_MAX_HELD,
+               "in-flight frames can hold every stream item");
+
+struct stream_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;			// sizeof(struct stream_header)
+	uint32_t frame;			// frames offered by the server so far
+	uint16_t width;
+	uint16_t height;
+	uint32_t packet_size;		// bytes that follow
+	float temperature;		// detector, deg C
+	int64_t mono_sec;		// arrival time, CLOCK_MONOTONIC
+	int64_t mono_nsec;
+	int64_t utc_sec;		// arrival time, UTC
+	int64_t utc_nsec;
+};
+
+struct stream_datagram {
+	uint32_t magic;
+	uint32_t seq;			// datagrams sent so far
+	uint32_t frame;			// stream_header.frame
+	uint16_t chunk;			// payload offset / STREAM_UDP_CHUNK
+	uint16_t nchunks;		// datagrams in this frame
+};
+
+// A frame on its way to one or more subscribers
+struct stream_item {
+	struct thermapp_frame *frame;
+	struct stream_header hdr;
+	int refs;			// queue entries still using it
+};
+
+struct stream_zc_range {
+	uint32_t lo;
+	uint32_t hi;
+};
+
+struct stream_client {
+	int fd;
+	int zerocopy;			// send with MSG_ZEROCOPY
+	uint32_t zc_next;		// id of the next zerocopy send
+	uint32_t zc_done;		// sends below this have completed
+	// completed ranges past a send that has not completed yet
+	struct stream_zc_range zc_range[STREAM_ZC_RANGES];
+	int nranges;
+	size_t off;			// bytes of item[sent] already sent
+	// free-running queue indices: [head, sent) are sent and wait for
+	// their zerocopy completion, [sent, tail) are still to be sent
+	unsigned int head;
+	unsigned int sent;
+	unsigned int tail;
+	struct stream_item *item[STREAM_QUEUE];
+	uint32_t last_zc[STREAM_QUEUE];	// done once zc_done is past this
+	unsigned int dropped;
+	struct timespec deadline;	// closing: reset the connection after
+};
+
+struct stream_subscriber {
+	struct sockaddr_in addr;
+	struct timespec seen;
+};
+
+typedef struct stream {
+	ThermApp *therm;
+	int listen_fd;
+	int udp_fd;			// -1 without UDP
+	int wake_fd;			// eventfd, new frame or shutdown
+	pthread_t thread;
+	int started;
+	int stopping;
+	pthread_mutex_t mutex;
+
+	// Counts every frame offered, also those skipped while the server
+	// thread held the lock, so skips show up as gaps in hdr.frame
+	atomic_uint frame;
+	uint32_t udp_seq;
+	atomic_uint busy;		// frames skipped, server thread was busy
+	struct stream_item items[STREAM_MAX_HELD];
+
+	struct stream_client clients[STREAM_MAX_CLIENTS];
+	int nclients;
+	// disconnected, waiting for their last zerocopy completions; they
+	// count towards STREAM_MAX_CLIENTS
+	struct stream_client closing[STREAM_MAX_CLIENTS];
+	int nclosing;
+
+	struct stream_subscriber subs[STREAM_MAX_CLIENTS];
+	int nsubs;
+	struct stream_item *udp_item[STREAM_QUEUE];
+	unsigned int udp_head;
+	unsigned int udp_tail;
+
+	// datagrams of one frame, rebuilt for every frame
+	int nchunks;
+	struct stream_datagram *chunk_hdr;
+	struct iovec *chunk_iov;
+	struct mmsghdr *chunk_msg;
+} Stream;
+
+Stream *stream_open(ThermApp *therm, int port, int udp);
+void stream_close(Stream *st);
+void stream_publish(Stream *st, struct thermapp_frame *frame);
+
+#endif /* STREAM_H_ */
@@ -0,0 +1,23 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+// Minimal checks for the make check programs: a failed CHECK reports
+// where and why, and the program exits non-zero through TEST_RESULT.
+
+static int test_failures;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fputc('\n', stderr); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_RESULT(name) \
+	(printf("%s: %s\n", name, test_failures ? "FAILED" : "ok"), test_failures != 0)
+
+#endif /* TEST_H_ */
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "bin.h"
+#include "test.h"
+
+#define IN_W 384
+#define IN_H 288
+
+static int16_t in[IN_W * IN_H];
+static int16_t out[IN_W * IN_H];
+
+// Every output pixel is the rounded mean of its factor x factor block of
+// the region of interest
+static void
+test_roi(int x0, int y0, int w, int h, int f)
+{
+	Binning *bn = bin_open(IN_W, IN_H, x0, y0, w, h, f);
+	CHECK(bn, "bin_open %dx%d+%d+%d /%d failed", w, h, x0, y0, f);
+	if (!bn)
+		return;
+	CHECK(bn->width == w / f && bn->height == h / f, "output %dx%d for %dx%d /%d",
+	      bn->width, bn->height, w, h, f);
+
+	bin_apply(bn, in, out);
+	int bad = 0;
+	for (int y = 0; y < bn->height; y++) {
+		for (int x = 0; x < bn->width; x++) {
+			int32_t s = 0;
+			for (int j = 0; j < f; j++) {
+				for (int i = 0; i < f; i++) {
+					s += in[(y0 + y * f + j) * IN_W + x0 + x * f + i];
+				}
+			}
+			int32_t want = f == 1 ? s : (s + f * f / 2) >> (f == 2 ? 2 : 4);
+			bad += out[y * bn->width + x] != want;
+		}
+	}
+	CHECK(bad == 0, "%d wrong pixels for %dx%d+%d+%d /%d", bad, w, h, x0, y0, f);
+	bin_close(bn);
+}
+
+int
+main(void)
+{
+	srand(1);
+	for (int i = 0; i < IN_W * IN_H; i++) {
+		in[i] = rand() % 65536 - 32768;
+	}
+
+	test_roi(0, 0, IN_W, IN_H, 1);
+	test_roi(0, 0, IN_W, IN_H, 2);
+	test_roi(0, 0, IN_W, IN_H, 4);
+	test_roi(96, 64, 192, 160, 2);
+	test_roi(8, 4, 96, 64, 4);
+	test_roi(IN_W - 4, IN_H - 4, 4, 4, 4);
+	test_roi(1, 3, 5, 7, 1);
+
+	// Full scale stays in range when averaged
+	for (int i = 0; i < IN_W * IN_H; i++) {
+		in[i] = i & 1 ? INT16_MAX : INT16_MIN;
+	}
+	test_roi(0, 0, IN_W, IN_H, 4);
+
+	// Geometry the binning cannot represent is refused
+	CHECK(!bin_open(IN_W, IN_H, 0, 0, IN_W, IN_H, 3), "factor 3 accepted");
+	CHECK(!bin_open(IN_W, IN_H, 0, 0, 190, 160, 4), "ragged ROI accepted");
+	CHECK(!bin_open(IN_W, IN_H, 300, 0, 100, 100, 1), "ROI outside the frame accepted");
+	CHECK(!bin_open(IN_W, IN_H, -2, 0, 100, 100, 2), "negative origin accepted");
+
+	return TEST_RESULT("bin");
+}
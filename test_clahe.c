@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clahe.h"
+#include "test.h"
+
+#define W 384
+#define H 288
+
+static int16_t frame[W * H];
+static uint8_t out_inc[W * H];
+static uint8_t out_full[W * H];
+
+// A gradient with a bright blob that moves and noise on top. The first
+// and last pixels pin the frame range, so the range found for one frame
+// fits all the others.
+static void
+make_frame(int k, int offset)
+{
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < W; x++) {
+			int dx = x - 100 - 2 * k, dy = y - 100 - k;
+			int v = 1000 + x + y / 2 + rand() % 50;
+			if (dx * dx + dy * dy < 400) {
+				v += 1500;
+			}
+			frame[y * W + x] = v + offset;
+		}
+	}
+	frame[0] = offset;
+	frame[W * H - 1] = 4000 + offset;
+}
+
+// The cached bins follow the frame and every histogram counts them
+static void
+check_state(const Clahe *cl, int k)
+{
+	int bad_bin = 0, bad_hist = 0;
+	uint16_t *hist = calloc(cl->ntx * cl->nty * CLAHE_BINS, sizeof *hist);
+	if (!hist)
+		return;
+
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < W; x++) {
+			int32_t d = frame[y * W + x] - cl->lo;
+			uint32_t b = ((uint32_t)(d < 0 ? 0 : d) * cl->scale) >> 16;
+			b = b < CLAHE_BINS ? b : CLAHE_BINS - 1;
+			bad_bin += cl->bin[y * W + x] != b;
+			int t = (y / cl->tile_h) * cl->ntx + x / cl->tile_w;
+			hist[t * CLAHE_BINS + cl->bin[y * W + x]]++;
+		}
+	}
+	bad_hist = memcmp(hist, cl->hist, cl->ntx * cl->nty * CLAHE_BINS * sizeof *hist) != 0;
+	free(hist);
+
+	CHECK(bad_bin == 0, "frame %d: %d pixels in the wrong bin", k, bad_bin);
+	CHECK(!bad_hist, "frame %d: histograms do not match the bins", k);
+}
+
+// Frames mapped incrementally give exactly what a new Clahe computes
+// from scratch for the same frame
+static void
+test_incremental(void)
+{
+	Clahe *inc = clahe_open(W, H);
+	CHECK(inc, "clahe_open failed");
+	if (!inc)
+		return;
+
+	srand(1);
+	for (int k = 0; k < 40; k++) {
+		// halfway the scene warms up past the range: rebuild
+		make_frame(k, k < 20 ? 0 : 6000);
+		clahe_apply(inc, frame, out_inc);
+		check_state(inc, k);
+
+		Clahe *full = clahe_open(W, H);
+		if (!full)
+			break;
+		clahe_apply(full, frame, out_full);
+		CHECK(full->lo == inc->lo && full->hi == inc->hi, "frame %d: range %d..%d, want %d..%d",
+		      k, inc->lo, inc->hi, full->lo, full->hi);
+		CHECK(memcmp(out_inc, out_full, sizeof out_inc) == 0,
+		      "frame %d: incremental and full mapping differ", k);
+		clahe_close(full);
+	}
+
+	int lo = 255, hi = 0;
+	for (int i = 0; i < W * H; i++) {
+		lo = out_inc[i] < lo ? out_inc[i] : lo;
+		hi = out_inc[i] > hi ? out_inc[i] : hi;
+	}
+	CHECK(lo >= CLAHE_OUT_MIN && hi <= CLAHE_OUT_MAX, "output %d..%d", lo, hi);
+	CHECK(hi - lo > (CLAHE_OUT_MAX - CLAHE_OUT_MIN) / 2, "output only spans %d..%d", lo, hi);
+
+	clahe_close(inc);
+}
+
+static void
+test_clip(void)
+{
+	Clahe *cl = clahe_open(W, H);
+	CHECK(cl, "clahe_open failed");
+	if (!cl)
+		return;
+	CHECK(clahe_set_clip(cl, 2.0f) == 0, "clip 2 rejected");
+	CHECK(clahe_set_clip(cl, 0.5f) != 0, "clip below 1 accepted");
+	CHECK(clahe_set_clip(cl, CLAHE_MAX_CLIP * 2) != 0, "clip above the maximum accepted");
+	clahe_close(cl);
+}
+
+int
+main(void)
+{
+	test_incremental();
+	test_clip();
+	return TEST_RESULT("clahe");
+}
@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "denoise.h"
+#include "test.h"
+
+#define W 37
+#define H 23
+
+static int
+cmp_int16(const void *a, const void *b)
+{
+	return *(const int16_t *)a - *(const int16_t *)b;
+}
+
+// The 3x3 median against a plain sort of every window
+static void
+test_median(void)
+{
+	int16_t in[W * H], frame[W * H];
+
+	Denoise *dn = denoise_open(W, H);
+	CHECK(dn, "denoise_open failed");
+	if (!dn)
+		return;
+
+	srand(1);
+	for (int i = 0; i < W * H; i++) {
+		in[i] = rand() % 20000 - 10000;
+	}
+	memcpy(frame, in, sizeof frame);
+	dn->median = 1;
+	denoise_apply(dn, frame);
+
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < W; x++) {
+			int16_t want = in[y * W + x];
+			if (y > 0 && y < H - 1 && x > 0 && x < W - 1) {
+				int16_t v[9];
+				int k = 0;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						v[k++] = in[(y + dy) * W + x + dx];
+					}
+				}
+				qsort(v, 9, sizeof *v, cmp_int16);
+				want = v[4];
+			}
+			CHECK(frame[y * W + x] == want, "median at %d,%d: %d, want %d",
+			      x, y, frame[y * W + x], want);
+		}
+	}
+	denoise_close(dn);
+}
+
+// The recursive filter: the first frame primes it, small steps are
+// smoothed towards the new level, steps past the gate go straight through
+static void
+test_temporal(void)
+{
+	int16_t frame[W * H];
+
+	Denoise *dn = denoise_open(W, H);
+	CHECK(dn, "denoise_open failed");
+	if (!dn)
+		return;
+	dn->temporal = 1;
+	CHECK(denoise_set_alpha(dn, 64) == 0, "alpha 64 rejected");
+	CHECK(denoise_set_threshold(dn, 40) == 0, "threshold 40 rejected");
+
+	for (int i = 0; i < W * H; i++) {
+		frame[i] = 1000;
+	}
+	denoise_apply(dn, frame);
+	CHECK(frame[0] == 1000, "first frame changed: %d", frame[0]);
+
+	// 1000 + 20 * 64/256 = 1005
+	for (int i = 0; i < W * H; i++) {
+		frame[i] = 1020;
+	}
+	denoise_apply(dn, frame);
+	CHECK(frame[0] == 1005, "small step: %d, want 1005", frame[0]);
+
+	int prev = frame[0];
+	for (int t = 0; t < 60; t++) {
+		for (int i = 0; i < W * H; i++) {
+			frame[i] = 1020;
+		}
+		denoise_apply(dn, frame);
+		CHECK(frame[0] >= prev && frame[0] <= 1020, "not converging: %d after %d", frame[0], prev);
+		prev = frame[0];
+	}
+	CHECK(frame[W * H - 1] == 1020, "settled at %d, want 1020", frame[W * H - 1]);
+
+	for (int i = 0; i < W * H; i++) {
+		frame[i] = 2000;
+	}
+	denoise_apply(dn, frame);
+	CHECK(frame[0] == 2000, "step past the gate filtered: %d", frame[0]);
+
+	// Noise around a level is reduced, not amplified
+	srand(2);
+	double var_in = 0, var_out = 0;
+	int n = 0;
+	for (int t = 0; t < 40; t++) {
+		for (int i = 0; i < W * H; i++) {
+			frame[i] = 2000 + rand() % 21 - 10;
+			if (t >= 20) {
+				var_in += (frame[i] - 2000) * (frame[i] - 2000);
+			}
+		}
+		denoise_apply(dn, frame);
+		if (t >= 20) {
+			for (int i = 0; i < W * H; i++) {
+				var_out += (frame[i] - 2000) * (frame[i] - 2000);
+			}
+			n += W * H;
+		}
+	}
+	CHECK(var_out < var_in / 2, "noise variance %.1f -> %.1f", var_in / n, var_out / n);
+
+	denoise_close(dn);
+}
+
+int
+main(void)
+{
+	test_median();
+	test_temporal();
+	return TEST_RESULT("denoise");
+}
@@ -0,0 +1,131 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "detect.h"
+#include "test.h"
+
+#define W 384
+#define H 288
+
+static int16_t frame[W * H];
+
+// Sloped background with +-10 counts of uniform noise
+static void
+background(void)
+{
+	srand(1);
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < W; x++) {
+			frame[y * W + x] = 100 + x / 5 + y / 10 + rand() % 21 - 10;
+		}
+	}
+}
+
+static void
+add_star(float sx, float sy, float amp)
+{
+	for (int y = (int)sy - 6; y <= (int)sy + 6; y++) {
+		for (int x = (int)sx - 6; x <= (int)sx + 6; x++) {
+			if (x < 0 || y < 0 || x >= W || y >= H)
+				continue;
+			float dx = x - sx, dy = y - sy;
+			frame[y * W + x] += lrintf(amp * expf(-(dx * dx + dy * dy) / (2 * 1.5f * 1.5f)));
+		}
+	}
+}
+
+// Known stars are found at their position, brightest first, and nothing
+// else is
+static void
+test_centroids(Detect *dt)
+{
+	const float sx[] = { 50.3f, 200.7f, 330.2f, 120.5f };
+	const float sy[] = { 40.6f, 150.2f, 260.9f, 230.1f };
+	const float amp[] = { 800, 300, 120, 500 };
+	const int order[] = { 0, 3, 1, 2 };
+	const int n = sizeof sx / sizeof *sx;
+
+	background();
+	for (int k = 0; k < n; k++) {
+		add_star(sx[k], sy[k], amp[k]);
+	}
+
+	int nsrc = detect_run(dt, frame);
+	CHECK(nsrc == n, "%d sources, want %d", nsrc, n);
+	for (int i = 0; i < nsrc && i < n; i++) {
+		const struct detect_source *s = &dt->sources[i];
+		int k = order[i];
+		CHECK(fabsf(s->x - sx[k]) < 0.15f && fabsf(s->y - sy[k]) < 0.15f,
+		      "source %d at %.2f,%.2f, want %.2f,%.2f", i, s->x, s->y, sx[k], sy[k]);
+		// A 2D gaussian holds 2 pi sigma^2 amp; only the pixels above
+		// the threshold are summed, which misses more of a faint star
+		float flux = 2 * M_PI * 1.5f * 1.5f * amp[k];
+		CHECK(s->flux > 0.6f * flux && s->flux < 1.1f * flux,
+		      "source %d flux %.0f, want about %.0f", i, s->flux, flux);
+		CHECK(s->peak > 0.8f * amp[k] && s->peak < 1.2f * amp[k] + 20,
+		      "source %d peak %.0f, want about %.0f", i, s->peak, amp[k]);
+		CHECK(s->npix >= DETECT_MIN_PIXELS, "source %d has %u pixels", i, s->npix);
+	}
+}
+
+static void
+test_empty(Detect *dt)
+{
+	background();
+	int nsrc = detect_run(dt, frame);
+	CHECK(nsrc == 0, "%d sources in pure background", nsrc);
+}
+
+// More stars than fit: the brightest DETECT_MAX_SOURCES are kept, sorted
+// by flux. Star k of the grid is brighter than star k - 1.
+#define GRID 16
+#define GRID_NX ((W - 2 * 12) / GRID + 1)
+
+static void
+test_crowded(Detect *dt)
+{
+	int nstar = 0;
+
+	background();
+	for (int y = 12; y < H - 12; y += GRID) {
+		for (int x = 12; x < W - 12; x += GRID) {
+			add_star(x + 0.25f, y + 0.25f, 150 + 4 * nstar++);
+		}
+	}
+	CHECK(nstar > DETECT_MAX_SOURCES, "only %d stars", nstar);
+
+	int nsrc = detect_run(dt, frame);
+	int outside = 0;
+	CHECK(nsrc == DETECT_MAX_SOURCES, "%d sources, want %d", nsrc, DETECT_MAX_SOURCES);
+	for (int i = 0; i < nsrc; i++) {
+		const struct detect_source *s = &dt->sources[i];
+		int gx = lrintf((s->x - 12) / GRID), gy = lrintf((s->y - 12) / GRID);
+		int k = gy * GRID_NX + gx;
+		CHECK(fabsf(s->x - (12 + gx * GRID + 0.25f)) < 0.3f
+		   && fabsf(s->y - (12 + gy * GRID + 0.25f)) < 0.3f,
+		      "source %d at %.2f,%.2f is off the grid", i, s->x, s->y);
+		outside += k < nstar - DETECT_MAX_SOURCES;
+		if (i > 0) {
+			CHECK(s->flux <= s[-1].flux, "not sorted by flux at %d", i);
+		}
+	}
+	// The stars raise the background estimate of their cells, which
+	// shifts the fluxes a little; nearly all kept must be the brightest
+	CHECK(outside <= DETECT_MAX_SOURCES / 10, "%d of the kept stars are not the brightest", outside);
+}
+
+int
+main(void)
+{
+	Detect *dt = detect_open(W, H, DETECT_SIGMA);
+	CHECK(dt, "detect_open failed");
+	if (!dt)
+		return TEST_RESULT("detect");
+
+	test_centroids(dt);
+	test_empty(dt);
+	test_crowded(dt);
+
+	detect_close(dt);
+	return TEST_RESULT("detect");
+}
@@ -0,0 +1,177 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "thermapp.h"
+#include "framebus.h"
+#include "test.h"
+
+#define RAW_W   384
+#define RAW_H   288
+#define CAL_W   96
+#define CAL_H   72
+#define NFRAMES 2000
+
+static char name[64];
+static pthread_barrier_t attached;
+static int16_t raw[RAW_W * RAW_H];
+static int16_t cal[CAL_W * CAL_H];
+
+static void
+publish(FrameBus *bus, uint32_t n)
+{
+	struct cfg_packet hdr;
+	struct timespec now;
+	struct detect_source src = { .x = n, .y = -(float)n, .npix = n };
+
+	memset(&hdr, 0, sizeof hdr);
+	clock_gettime(CLOCK_REALTIME, &now);
+	for (int i = 0; i < RAW_W * RAW_H; i++) {
+		raw[i] = n;
+	}
+	for (int i = 0; i < CAL_W * CAL_H; i++) {
+		cal[i] = -(int16_t)n;
+	}
+	framebus_publish(bus, &hdr, n * 0.5f, &now, &now, raw, cal, &src, 1);
+}
+
+// Single-threaded: publishing, reading in place and a reader that holds
+// a view while its slot is reused
+static void
+test_ring(void)
+{
+	struct framebus_view v, old;
+
+	FrameBus *bus = framebus_create(name, RAW_W, RAW_H, CAL_W, CAL_H, FRAMEBUS_SLOTS);
+	CHECK(bus, "framebus_create failed");
+	if (!bus)
+		return;
+	FrameBus *rd = framebus_attach(name);
+	CHECK(rd, "framebus_attach failed");
+	if (!rd) {
+		framebus_close(bus);
+		return;
+	}
+
+	CHECK(framebus_latest(rd, &v) != 0, "view of an empty bus");
+	CHECK(framebus_wait(rd, 0, 10) != 0, "wait on an empty bus returned");
+
+	publish(bus, 1);
+	CHECK(framebus_wait(rd, 0, 10) == 0, "wait missed a frame");
+	CHECK(framebus_latest(rd, &old) == 0, "no view of frame 1");
+	CHECK(old.frame == 1, "frame %u, want 1", old.frame);
+	CHECK(old.raw[0] == 1 && old.cal && old.cal[CAL_W * CAL_H - 1] == -1,
+	      "pixels %d %d", old.raw[0], old.cal ? old.cal[0] : 0);
+	CHECK(old.nsources == 1 && old.sources[0].npix == 1, "sources %u", old.nsources);
+	CHECK(old.slot->temperature == 0.5f, "temperature %f", old.slot->temperature);
+	CHECK(framebus_check(&old), "untouched view fails its check");
+
+	for (uint32_t n = 2; n <= FRAMEBUS_SLOTS; n++) {
+		publish(bus, n);
+	}
+	CHECK(framebus_check(&old), "view failed before its slot was reused");
+	publish(bus, FRAMEBUS_SLOTS + 1);
+	CHECK(!framebus_check(&old), "view of an overwritten slot passes its check");
+
+	CHECK(framebus_latest(rd, &v) == 0 && v.frame == FRAMEBUS_SLOTS + 1,
+	      "latest is %u, want %d", v.frame, FRAMEBUS_SLOTS + 1);
+
+	framebus_close(rd);
+	framebus_close(bus);
+}
+
+struct reader {
+	int accepted;
+	int rejected;
+	int torn;		// accepted but inconsistent, must stay 0
+	int backwards;
+};
+
+static void *
+reader_thread(void *ctx)
+{
+	struct reader *r = ctx;
+	static int16_t copy[RAW_W * RAW_H];
+	struct framebus_view v;
+	uint32_t last = 0;
+
+	FrameBus *rd = framebus_attach(name);
+	pthread_barrier_wait(&attached);
+	if (!rd)
+		return NULL;
+	while (last < NFRAMES && framebus_wait(rd, last, 1000) == 0) {
+		// In place
+		if (framebus_latest(rd, &v) == 0) {
+			int16_t first = v.raw[0];
+			int same = v.cal != NULL;
+			for (int i = 0; i < RAW_W * RAW_H && same; i += 97) {
+				same = v.raw[i] == first;
+			}
+			for (int i = 0; i < CAL_W * CAL_H && same; i += 31) {
+				same = v.cal[i] == -first;
+			}
+			same = same && v.nsources == 1 && v.sources[0].npix == (uint32_t)first;
+			if (framebus_check(&v)) {
+				r->accepted++;
+				r->torn += !same || first != (int16_t)v.frame;
+				r->backwards += v.frame < last;
+				last = v.frame;
+			} else {
+				r->rejected++;
+			}
+		}
+		// Copied
+		if (framebus_copy(rd, &v, copy, NULL) == 0) {
+			int same = 1;
+			for (int i = 0; i < RAW_W * RAW_H && same; i++) {
+				same = copy[i] == (int16_t)v.frame;
+			}
+			r->accepted++;
+			r->torn += !same;
+			r->backwards += v.frame < last;
+			last = v.frame;
+		}
+	}
+	framebus_close(rd);
+	return NULL;
+}
+
+// A reader racing the producer never accepts a torn frame
+static void
+test_concurrent(void)
+{
+	struct reader r = {0};
+	pthread_t th;
+
+	FrameBus *bus = framebus_create(name, RAW_W, RAW_H, CAL_W, CAL_H, FRAMEBUS_SLOTS);
+	CHECK(bus, "framebus_create failed");
+	if (!bus)
+		return;
+	pthread_barrier_init(&attached, NULL, 2);
+	if (pthread_create(&th, NULL, reader_thread, &r)) {
+		CHECK(0, "pthread_create failed");
+		framebus_close(bus);
+		return;
+	}
+	pthread_barrier_wait(&attached);
+	for (uint32_t n = 1; n <= NFRAMES; n++) {
+		publish(bus, n);
+	}
+	pthread_join(th, NULL);
+	pthread_barrier_destroy(&attached);
+	framebus_close(bus);
+
+	CHECK(r.accepted > 0, "reader accepted no frame");
+	CHECK(r.torn == 0, "%d torn frames accepted", r.torn);
+	CHECK(r.backwards == 0, "%d frames went backwards", r.backwards);
+}
+
+int
+main(void)
+{
+	snprintf(name, sizeof name, "/astrotherm_test_%d", (int)getpid());
+	test_ring();
+	test_concurrent();
+	return TEST_RESULT("framebus");
+}
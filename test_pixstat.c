@@ -0,0 +1,163 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pixstat.h"
+#include "test.h"
+
+#define W 16
+#define H 8
+#define NPIX (W * H)
+#define FLICKER (3 * W + 5)
+#define DRIFT (6 * W + 11)
+
+static int16_t frames[2 * PIXSTAT_WINDOW][NPIX];
+
+// pixstat_feed() drops a frame while the stats thread is busy, so wait
+// until it is idle and feed again until the frame has been taken. The
+// thread only reads pending[], so frame[0] showing up there over a
+// different value put in beforehand means the copy was made.
+static void
+feed(PixStat *ps, const int16_t *frame)
+{
+	int taken = 0, pending = 1;
+
+	while (!taken) {
+		pthread_mutex_lock(&ps->mutex_feed);
+		pending = ps->have_pending;
+		if (!pending) {
+			ps->pending[0] = frame[0] ^ 1;
+		}
+		pthread_mutex_unlock(&ps->mutex_feed);
+		if (pending) {
+			usleep(100);
+			continue;
+		}
+		pixstat_feed(ps, frame);
+		pthread_mutex_lock(&ps->mutex_feed);
+		taken = ps->have_pending || ps->pending[0] == frame[0];
+		pthread_mutex_unlock(&ps->mutex_feed);
+	}
+	// wait until it is accumulated
+	for (pending = 1; pending; ) {
+		pthread_mutex_lock(&ps->mutex_feed);
+		pending = ps->have_pending;
+		pthread_mutex_unlock(&ps->mutex_feed);
+		if (pending) {
+			usleep(100);
+		}
+	}
+}
+
+// Wait for the evaluation at the end of a window, at most 2 s
+static int
+wait_ready(PixStat *ps)
+{
+	for (int t = 0; t < 2000; t++) {
+		if (atomic_load(&ps->ready))
+			return 0;
+		usleep(1000);
+	}
+	return -1;
+}
+
+// A flat frame with a little noise, a pixel jumping by +-500 every frame
+// and one ramping up by 15 counts per frame
+static void
+make_frames(void)
+{
+	srand(3);
+	for (int t = 0; t < 2 * PIXSTAT_WINDOW; t++) {
+		for (int i = 0; i < NPIX; i++) {
+			frames[t][i] = 1000 + rand() % 101 - 50;
+		}
+		frames[t][FLICKER] = t & 1 ? 1500 : 500;
+		frames[t][DRIFT] = 1000 + 15 * t;
+	}
+}
+
+// Flagged pixels of a map, and whether they are exactly want[]
+static int
+check_map(const uint8_t *map, const int *want, int nwant)
+{
+	int ok = 1;
+
+	for (int i = 0; i < NPIX; i++) {
+		int expect = 0;
+		for (int k = 0; k < nwant; k++) {
+			expect |= i == want[k];
+		}
+		if (!map[i] != !expect) {
+			CHECK(0, "pixel %d,%d flagged %d, want %d", i % W, i / W, map[i], expect);
+			ok = 0;
+		}
+	}
+	return ok;
+}
+
+// Over the first window the running statistics are the plain mean and
+// population variance of the samples
+static void
+test_window(PixStat *ps)
+{
+	for (int t = 0; t < PIXSTAT_WINDOW; t++) {
+		feed(ps, frames[t]);
+	}
+
+	for (int i = 0; i < NPIX; i++) {
+		double s = 0, ss = 0;
+		for (int t = 0; t < PIXSTAT_WINDOW; t++) {
+			s += frames[t][i];
+		}
+		double mean = s / PIXSTAT_WINDOW;
+		for (int t = 0; t < PIXSTAT_WINDOW; t++) {
+			ss += (frames[t][i] - mean) * (frames[t][i] - mean);
+		}
+		double var = ss / PIXSTAT_WINDOW;
+		CHECK(fabs(ps->mean[i] - mean) < 1e-4 * fabs(mean),
+		      "mean of pixel %d: %f, want %f", i, ps->mean[i], mean);
+		CHECK(fabs(ps->var[i] - var) < 1e-2 + 1e-3 * var,
+		      "variance of pixel %d: %f, want %f", i, ps->var[i], var);
+	}
+
+	CHECK(wait_ready(ps) == 0, "no bad-pixel map after the first window");
+	const int want[] = { FLICKER, DRIFT };
+	CHECK(check_map(pixstat_badmap(ps), want, 2), "wrong pixels after the first window");
+	CHECK(pixstat_nbad(ps) == 2, "%d bad pixels, want 2", pixstat_nbad(ps));
+}
+
+// In the second window the ramp is flagged for having drifted from its
+// mean over the first one, even with the variance limit out of reach
+static void
+test_drift(PixStat *ps)
+{
+	ps->var_factor = 1e9f;
+	for (int t = PIXSTAT_WINDOW; t < 2 * PIXSTAT_WINDOW; t++) {
+		feed(ps, frames[t]);
+	}
+
+	CHECK(wait_ready(ps) == 0, "no bad-pixel map after the second window");
+	const int want[] = { DRIFT };
+	CHECK(check_map(pixstat_badmap(ps), want, 1), "wrong pixels after the second window");
+	CHECK(pixstat_nbad(ps) == 1, "%d bad pixels, want 1", pixstat_nbad(ps));
+}
+
+int
+main(void)
+{
+	uint8_t static_map[NPIX] = { 0 };
+
+	make_frames();
+	PixStat *ps = pixstat_open(NPIX, static_map, 1);
+	CHECK(ps, "pixstat_open failed");
+	if (!ps)
+		return TEST_RESULT("pixstat");
+
+	CHECK(pixstat_nbad(ps) == 0, "%d bad pixels before any frame", pixstat_nbad(ps));
+	test_window(ps);
+	test_drift(ps);
+
+	pixstat_close(ps);
+	return TEST_RESULT("pixstat");
+}
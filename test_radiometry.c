@@ -0,0 +1,126 @@
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "radiometry.h"
+#include "test.h"
+
+#define KELVIN 273.15
+
+static char calfile[] = "/tmp/astrotherm_test_XXXXXX";
+
+static int
+write_cal(const char *text)
+{
+	FILE *f = fopen(calfile, "w");
+	if (!f)
+		return -1;
+	fputs(text, f);
+	return fclose(f);
+}
+
+// Counts of a scene at T deg C with the model of the calibration below
+static double
+model_counts(double t, double td)
+{
+	const double R = 1.0e6 + 500 * td, B = 1400, F = 1, O = 4000 - 10 * td;
+	const double e = 0.9, refl = R / (exp(B / (20 + KELVIN)) - F);
+
+	return e * R / (exp(B / (t + KELVIN)) - F) + (1 - e) * refl + O;
+}
+
+// Scene temperature -> counts -> table -> temperature, within what one
+// count is worth at that temperature
+static void
+test_round_trip(Radiometry *rad)
+{
+	const float td = 30.3f;
+
+	radiometry_update(rad, td);
+	for (double t = -20; t <= 120; t += 2.5) {
+		double c = model_counts(t, td);
+		CHECK(c < INT16_MAX, "%.1f C is out of the sensor range", t);
+		int16_t counts = lrint(c), scaled;
+		float temp;
+
+		radiometry_apply(rad, &counts, &temp, 1);
+		radiometry_apply_scaled(rad, &counts, &scaled, 1);
+
+		double per_count = 1 / (model_counts(t + 0.5, td) - model_counts(t - 0.5, td));
+		double tol = 0.6 * per_count + 1e-3;
+		CHECK(fabs(temp - t) <= tol, "%.1f C -> %d counts -> %.3f C", t, counts, temp);
+		double back = RADIOMETRY_BZERO + RADIOMETRY_BSCALE * scaled;
+		CHECK(fabs(back - temp) <= RADIOMETRY_BSCALE / 2 + 1e-4,
+		      "scaled %d for %.3f C", scaled, temp);
+	}
+
+	// Below the offset there is no temperature
+	int16_t low = 1000, scaled;
+	float temp;
+	radiometry_apply(rad, &low, &temp, 1);
+	radiometry_apply_scaled(rad, &low, &scaled, 1);
+	CHECK(isnan(temp), "counts below the offset give %.2f C", temp);
+	CHECK(scaled == RADIOMETRY_BLANK, "counts below the offset give scaled %d", scaled);
+}
+
+// The table is rebuilt only once the detector moved past the threshold
+static void
+test_threshold(Radiometry *rad)
+{
+	CHECK(radiometry_update(rad, 30.0f) == 1, "first table not built");
+	CHECK(radiometry_update(rad, 30.15f) == 0, "rebuilt within the threshold");
+	CHECK(radiometry_update(rad, 29.85f) == 0, "rebuilt within the threshold");
+	CHECK(radiometry_update(rad, 30.3f) == 1, "not rebuilt past the threshold");
+	CHECK(rad->lut_temp == 30.3f, "table built for %.2f C", rad->lut_temp);
+}
+
+static void
+test_parse_errors(void)
+{
+	static const char *bad[] = {
+		"B 1400\n",			// no R
+		"R 2e6\nB 1400\nGAIN 2\n",	// unknown parameter
+		"R 2e6\nB\n",			// no value
+		"R 2e6\nB 1400\nEMISSIVITY 0\n",
+		"R 2e6\nB 1400\nTHRESHOLD -1\n",
+	};
+
+	for (size_t i = 0; i < sizeof bad / sizeof *bad; i++) {
+		if (write_cal(bad[i]))
+			continue;
+		Radiometry *rad = radiometry_open(calfile);
+		CHECK(!rad, "accepted calibration %zu", i);
+		radiometry_close(rad);
+	}
+	CHECK(!radiometry_open("/nonexistent/astrotherm.cal"), "opened a missing file");
+}
+
+int
+main(void)
+{
+	int fd = mkstemp(calfile);
+	CHECK(fd >= 0, "mkstemp failed");
+	if (fd < 0)
+		return TEST_RESULT("radiometry");
+	close(fd);
+
+	CHECK(write_cal("# test camera\n"
+	                "R 1.0e6 500\n"
+	                "B 1400\n"
+	                "F 1\n"
+	                "O 4000 -10    # offset\n"
+	                "EMISSIVITY 0.9\n"
+	                "REFLECTED 20\n"
+	                "THRESHOLD 0.2\n") == 0, "cannot write %s", calfile);
+	Radiometry *rad = radiometry_open(calfile);
+	CHECK(rad, "radiometry_open failed");
+	if (rad) {
+		test_threshold(rad);
+		test_round_trip(rad);
+		radiometry_close(rad);
+	}
+	test_parse_errors();
+
+	unlink(calfile);
+	return TEST_RESULT("radiometry");
+}
@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "stream.h"
+#include "test.h"
+
+#define FRAME_BYTES (sizeof(struct stream_header) + sizeof(struct thermapp_packet))
+#define NFRAMES     40		// more than the pool, so frames are reused
+#define TEMPERATURE 31.5f
+
+// Stand-ins for the library's frame pool: stream.c only takes and drops
+// references and reads the detector temperature.
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct thermapp_frame pool[THERMAPP_POOL_SIZE];
+
+void
+thermapp_refFrame(ThermApp *thermapp, struct thermapp_frame *frame)
+{
+	pthread_mutex_lock(&pool_mutex);
+	frame->refs++;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+void
+thermapp_releaseFrame(ThermApp *thermapp, struct thermapp_frame *frame)
+{
+	pthread_mutex_lock(&pool_mutex);
+	CHECK(frame->refs > 0, "frame %d released once too often", (int)(frame - pool));
+	frame->refs--;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+float
+thermapp_getFrameTemperature(const struct thermapp_frame *frame)
+{
+	return TEMPERATURE;
+}
+
+static int
+frame_refs(struct thermapp_frame *frame)
+{
+	pthread_mutex_lock(&pool_mutex);
+	int refs = frame->refs;
+	pthread_mutex_unlock(&pool_mutex);
+	return refs;
+}
+
+// Any port will do, try a few in case one is taken
+static Stream *
+open_server(int *port)
+{
+	Stream *st = NULL;
+
+	for (int k = 0; k < 20 && !st; k++) {
+		*port = 20000 + (getpid() * 7 + k * 131) % 40000;
+		st = stream_open(NULL, *port, 1);
+	}
+	return st;
+}
+
+static int
+open_subscriber(int type, int port)
+{
+	struct sockaddr_in addr;
+	int rcvbuf = 4 << 20;
+
+	int fd = socket(AF_INET, type, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	// A UDP subscriber registers with any datagram
+	int ret = type == SOCK_STREAM
+	        ? connect(fd, (struct sockaddr *)&addr, sizeof addr)
+	        : (int)sendto(fd, "hello", 5, 0, (struct sockaddr *)&addr, sizeof addr);
+	if (ret < 0) {
+		perror(type == SOCK_STREAM ? "connect" : "sendto");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Wait until the server thread has picked up both subscribers
+static int
+wait_subscribed(Stream *st)
+{
+	for (int t = 0; t < 2000; t++) {
+		pthread_mutex_lock(&st->mutex);
+		int ok = st->nclients == 1 && st->nsubs == 1;
+		pthread_mutex_unlock(&st->mutex);
+		if (ok)
+			return 0;
+		usleep(1000);
+	}
+	return -1;
+}
+
+// Read one frame from each subscriber, polling both so that neither
+// socket buffer overflows while the other is read. UDP datagrams must
+// follow on from *seq and arrive in order.
+static int
+receive_frame(int tcp, int udp, char *tcpbuf, char *udpbuf, uint32_t *seq,
+              uint32_t *udp_frame)
+{
+	char dgram[sizeof(struct stream_datagram) + STREAM_UDP_CHUNK];
+	const struct stream_datagram *dg = (const struct stream_datagram *)dgram;
+	size_t have = 0, udp_bytes = 0;
+	int got = 0, nchunks = -1;
+
+	while (have < FRAME_BYTES || got != nchunks) {
+		struct pollfd pfd[2] = {
+			{ .fd = tcp, .events = have < FRAME_BYTES ? POLLIN : 0 },
+			{ .fd = udp, .events = got != nchunks ? POLLIN : 0 },
+		};
+		if (poll(pfd, 2, 2000) <= 0) {
+			CHECK(0, "timed out with %zu of %zu bytes and %d datagrams",
+			      have, FRAME_BYTES, got);
+			return -1;
+		}
+
+		if (pfd[0].revents) {
+			ssize_t n = recv(tcp, tcpbuf + have, FRAME_BYTES - have, MSG_DONTWAIT);
+			if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+				CHECK(0, "TCP connection lost");
+				return -1;
+			}
+			if (n > 0) {
+				have += n;
+			}
+		}
+
+		if (pfd[1].revents) {
+			ssize_t n = recv(udp, dgram, sizeof dgram, MSG_DONTWAIT);
+			if (n < 0)
+				continue;
+			if (n < (ssize_t)sizeof *dg || dg->magic != STREAM_MAGIC) {
+				CHECK(0, "not a stream datagram (%zd bytes)", n);
+				return -1;
+			}
+			CHECK(dg->seq == *seq, "datagram seq %u, want %u", dg->seq, *seq);
+			*seq = dg->seq + 1;
+			CHECK(dg->chunk == got, "chunk %u, want %d", dg->chunk, got);
+			if (got == 0) {
+				*udp_frame = dg->frame;
+				nchunks = dg->nchunks;
+			}
+			CHECK(dg->frame == *udp_frame && dg->nchunks == nchunks,
+			      "datagram of frame %u (%u chunks) within frame %u (%d chunks)",
+			      dg->frame, dg->nchunks, *udp_frame, nchunks);
+			size_t off = (size_t)dg->chunk * STREAM_UDP_CHUNK;
+			size_t len = n - sizeof *dg;
+			if (off + len > FRAME_BYTES) {
+				CHECK(0, "chunk %u past the end of the frame", dg->chunk);
+				return -1;
+			}
+			memcpy(udpbuf + off, dgram + sizeof *dg, len);
+			udp_bytes += len;
+			got++;
+		}
+	}
+	CHECK(udp_bytes == FRAME_BYTES, "%zu bytes over UDP, want %zu", udp_bytes, FRAME_BYTES);
+	return 0;
+}
+
+// Publish a frame and check what both subscribers receive: the header,
+// the frame number (skipped publishes leave gaps), the packet bytes.
+static int
+test_frame(Stream *st, int tcp, int udp, int k, char *tcpbuf, char *udpbuf,
+           uint32_t *seq)
+{
+	struct thermapp_frame *f = &pool[k % THERMAPP_POOL_SIZE];
+	const struct stream_header *hdr = (const struct stream_header *)tcpbuf;
+	uint32_t want, udp_frame = 0;
+
+	// The server may still hold it from the last round
+	for (int t = 0; t < 2000 && frame_refs(f); t++) {
+		usleep(1000);
+	}
+	if (frame_refs(f)) {
+		CHECK(0, "frame %d still held", k % THERMAPP_POOL_SIZE);
+		return -1;
+	}
+
+	memset(&f->packet->header, k, sizeof f->packet->header);
+	for (int i = 0; i < PIXELS_DATA_SIZE; i++) {
+		f->packet->pixels_data[i] = (int16_t)(k * 7 + i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &f->mono);
+	clock_gettime(CLOCK_REALTIME, &f->utc);
+
+	// As the capture thread: publish while holding the frame. A publish
+	// skipped because the server thread was busy is tried again.
+	thermapp_refFrame(NULL, f);
+	for (;;) {
+		unsigned int busy = atomic_load(&st->busy);
+		stream_publish(st, f);
+		if (atomic_load(&st->busy) == busy)
+			break;
+		usleep(100);
+	}
+	want = atomic_load(&st->frame);
+	thermapp_releaseFrame(NULL, f);
+
+	if (receive_frame(tcp, udp, tcpbuf, udpbuf, seq, &udp_frame))
+		return -1;
+
+	CHECK(hdr->magic == STREAM_MAGIC && hdr->version == STREAM_VERSION
+	      && hdr->size == sizeof *hdr, "frame %d: bad header", k);
+	CHECK(hdr->frame == want, "frame %d: number %u, want %u", k, hdr->frame, want);
+	CHECK(udp_frame == want, "frame %d: number %u over UDP, want %u", k, udp_frame, want);
+	CHECK(hdr->width == FRAME_WIDTH && hdr->height == FRAME_HEIGHT
+	      && hdr->packet_size == sizeof(struct thermapp_packet),
+	      "frame %d: %ux%u, %u bytes", k, hdr->width, hdr->height, hdr->packet_size);
+	CHECK(hdr->temperature == TEMPERATURE, "frame %d: temperature %f", k, hdr->temperature);
+	CHECK(hdr->mono_sec == f->mono.tv_sec && hdr->mono_nsec == f->mono.tv_nsec
+	      && hdr->utc_sec == f->utc.tv_sec && hdr->utc_nsec == f->utc.tv_nsec,
+	      "frame %d: wrong time stamps", k);
+	CHECK(memcmp(tcpbuf + sizeof *hdr, f->packet, sizeof *f->packet) == 0,
+	      "frame %d: packet differs over TCP", k);
+	CHECK(memcmp(udpbuf, tcpbuf, FRAME_BYTES) == 0, "frame %d: UDP differs from TCP", k);
+	return 0;
+}
+
+int
+main(void)
+{
+	char *tcpbuf = malloc(FRAME_BYTES);
+	char *udpbuf = malloc(FRAME_BYTES);
+	int tcp = -1, udp = -1, port;
+	uint32_t seq = 0;
+
+	for (int i = 0; i < THERMAPP_POOL_SIZE; i++) {
+		pool[i].packet = malloc(sizeof *pool[i].packet);
+		if (!pool[i].packet)
+			return 1;
+	}
+	if (!tcpbuf || !udpbuf)
+		return 1;
+
+	Stream *st = open_server(&port);
+	CHECK(st, "stream_open failed");
+	if (!st)
+		return TEST_RESULT("stream");
+
+	tcp = open_subscriber(SOCK_STREAM, port);
+	udp = open_subscriber(SOCK_DGRAM, port);
+	CHECK(tcp >= 0 && udp >= 0, "cannot connect to port %d", port);
+	if (tcp >= 0 && udp >= 0) {
+		CHECK(wait_subscribed(st) == 0, "subscribers not seen by the server");
+		for (int k = 0; k < NFRAMES && !test_failures; k++) {
+			test_frame(st, tcp, udp, k, tcpbuf, udpbuf, &seq);
+		}
+	}
+
+	stream_close(st);
+	for (int i = 0; i < THERMAPP_POOL_SIZE; i++) {
+		CHECK(pool[i].refs == 0, "frame %d held after stream_close", i);
+		free(pool[i].packet);
+	}
+	if (tcp >= 0) {
+		close(tcp);
+	}
+	if (udp >= 0) {
+		close(udp);
+	}
+	free(udpbuf);
+	free(tcpbuf);
+	return TEST_RESULT("stream");
+}
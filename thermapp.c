@@ -43,17 +43,26 @@ thermapp_open(void)
 		goto err2;
 	}
 
-	thermapp->data_in = malloc(ROUND_UP_512(sizeof *thermapp->data_in));
-	if (!thermapp->data_in) {
-		perror("malloc");
+	thermapp->cfg_next = calloc(1, sizeof *thermapp->cfg_next);
+	if (!thermapp->cfg_next) {
+		perror("calloc");
 		goto err2;
 	}
 
-	thermapp->data_done = malloc(ROUND_UP_512(sizeof *thermapp->data_done));
-	if (!thermapp->data_done) {
-		perror("malloc");
-		goto err2;
+	for (int i = 0; i < THERMAPP_POOL_SIZE; i++) {
+		struct thermapp_frame *frame = &thermapp->pool[i];
+		frame->packet = malloc(ROUND_UP_512(sizeof *frame->packet));
+		if (!frame->packet) {
+			perror("malloc");
+			goto err2;
+		}
+		if (i) {
+			frame->next_free = thermapp->frame_free;
+			thermapp->frame_free = frame;
+		}
 	}
+	thermapp->frame_in = &thermapp->pool[0];
+	thermapp->data_in = thermapp->frame_in->packet;
 
 	//Initialize data struct
 	// this init data was received from usbmonitor
@@ -84,6 +93,10 @@ thermapp_open(void)
 	thermapp->cfg->data_1e = 0x0000;
 	thermapp->cfg->data_1f = 0x0fff;
 
+	*thermapp->cfg_next = *thermapp->cfg;
+	thermapp->mutex_cfg = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+	thermapp->cfg_keepalive_ms = CFG_KEEPALIVE_MS;
+
 	return thermapp;
 
 err2:
@@ -130,8 +143,9 @@ thermapp_usb_connect(ThermApp *thermapp)
 	return 0;
 }
 
+// Only ever called on the event thread, which owns the transfers.
 static void
-thermapp_cancel_async(ThermApp *thermapp, int internal)
+thermapp_cancel_async(ThermApp *thermapp)
 {
 	if (thermapp->transfer_in) {
 		int ret = libusb_cancel_transfer(thermapp->transfer_in);
@@ -147,15 +161,13 @@ thermapp_cancel_async(ThermApp *thermapp, int internal)
 		}
 	}
 
-	if (internal) {
-		if (!thermapp->transfer_in && !thermapp->transfer_out) {
-			// All transfers cancelled.
-			// End the event loop and wake all waiters so they can exit.
-			pthread_mutex_lock(&thermapp->mutex_getimage);
-			thermapp->complete = 1;
-			pthread_cond_broadcast(&thermapp->cond_getimage);
-			pthread_mutex_unlock(&thermapp->mutex_getimage);
-		}
+	if (!thermapp->transfer_in && !thermapp->transfer_out) {
+		// All transfers cancelled.
+		// End the event loop and wake all waiters so they can exit.
+		pthread_mutex_lock(&thermapp->mutex_getimage);
+		thermapp->complete = 1;
+		pthread_cond_broadcast(&thermapp->cond_getimage);
+		pthread_mutex_unlock(&thermapp->mutex_getimage);
 	}
 }
 
@@ -165,17 +177,27 @@ transfer_cb_out(struct libusb_transfer *transfer)
 	ThermApp *thermapp = (ThermApp *)transfer->user_data;
 
 	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-		int ret = libusb_submit_transfer(transfer);
-		if (ret) {
-			fprintf(stderr, "libusb_submit_transfer: %s\n", libusb_strerror(ret));
-		}
+		// Resubmitted by thermapp_submit_cfg when the config changes
+		// or the keep-alive is due.
+		thermapp->out_busy = 0;
+		clock_gettime(CLOCK_MONOTONIC, &thermapp->out_last);
 	} else if (transfer->status == LIBUSB_TRANSFER_ERROR
 	        || transfer->status == LIBUSB_TRANSFER_NO_DEVICE
 	        || transfer->status == LIBUSB_TRANSFER_CANCELLED) {
 		libusb_free_transfer(thermapp->transfer_out);
 		thermapp->transfer_out = NULL;
 
-		thermapp_cancel_async(thermapp, 1);
+		thermapp_cancel_async(thermapp);
+	}
+}
+
+// Drop a reference to a pooled frame; mutex_getimage must be held
+static void
+thermapp_unref(ThermApp *thermapp, struct thermapp_frame *frame)
+{
+	if (--frame->refs == 0) {
+		frame->next_free = thermapp->frame_free;
+		thermapp->frame_free = frame;
 	}
 }
 
@@ -211,11 +233,30 @@ transfer_cb_in(struct libusb_transfer *transfer)
 
 			if (len == ROUND_UP_512(sizeof *thermapp->data_in)) {
 				// Frame complete.
+				struct timespec mono, utc;
+				clock_gettime(CLOCK_MONOTONIC, &mono);
+				clock_gettime(CLOCK_REALTIME, &utc);
+
 				pthread_mutex_lock(&thermapp->mutex_getimage);
-				struct thermapp_packet *tmp = thermapp->data_done;
-				thermapp->data_done = thermapp->data_in;
-				thermapp->data_in = tmp;
-				pthread_cond_broadcast(&thermapp->cond_getimage);
+				struct thermapp_frame *next = thermapp->frame_free;
+				if (next) {
+					thermapp->frame_free = next->next_free;
+					thermapp->frame_in->mono = mono;
+					thermapp->frame_in->utc = utc;
+					thermapp->frame_in->refs = 1;
+					if (thermapp->frame_done) {
+						thermapp_unref(thermapp, thermapp->frame_done);
+					}
+					thermapp->frame_done = thermapp->frame_in;
+					thermapp->frame_in = next;
+					thermapp->data_in = next->packet;
+					thermapp->nframes++;
+					pthread_cond_broadcast(&thermapp->cond_getimage);
+				} else {
+					// Every spare frame is held by a consumer;
+					// receive the next frame over this one.
+					thermapp->ndropped++;
+				}
 				pthread_mutex_unlock(&thermapp->mutex_getimage);
 
 				transfer->buffer = (unsigned char *)thermapp->data_in;
@@ -239,8 +280,52 @@ transfer_cb_in(struct libusb_transfer *transfer)
 		libusb_free_transfer(thermapp->transfer_in);
 		thermapp->transfer_in = NULL;
 
-		thermapp_cancel_async(thermapp, 1);
+		thermapp_cancel_async(thermapp);
+	}
+}
+
+// Called from the event thread between event handling.
+// Sends the staged config if it changed or the keep-alive has expired.
+static void
+thermapp_submit_cfg(ThermApp *thermapp)
+{
+	struct timespec now;
+	long elapsed_ms;
+	int ret;
+
+	if (!thermapp->transfer_out || thermapp->out_busy)
+		return;
+
+	if (atomic_load(&thermapp->stopping) || !thermapp->transfer_in) {
+		// Nothing in flight, so no callback will free it.
+		libusb_free_transfer(thermapp->transfer_out);
+		thermapp->transfer_out = NULL;
+		thermapp_cancel_async(thermapp);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ms = (now.tv_sec - thermapp->out_last.tv_sec) * 1000
+	           + (now.tv_nsec - thermapp->out_last.tv_nsec) / 1000000;
+
+	pthread_mutex_lock(&thermapp->mutex_cfg);
+	if (!thermapp->cfg_dirty && elapsed_ms < thermapp->cfg_keepalive_ms) {
+		pthread_mutex_unlock(&thermapp->mutex_cfg);
+		return;
+	}
+	if (thermapp->cfg_dirty) {
+		*thermapp->cfg = *thermapp->cfg_next;
+		thermapp->cfg_dirty = 0;
+	}
+	pthread_mutex_unlock(&thermapp->mutex_cfg);
+
+	ret = libusb_submit_transfer(thermapp->transfer_out);
+	if (ret) {
+		fprintf(stderr, "libusb_submit_transfer: %s\n", libusb_strerror(ret));
+		thermapp->out_last = now;
+		return;
 	}
+	thermapp->out_busy = 1;
 }
 
 static void *
@@ -263,6 +348,8 @@ thermapp_read_async(void *ctx)
 		fprintf(stderr, "libusb_submit_transfer: %s\n", libusb_strerror(ret));
 		libusb_free_transfer(thermapp->transfer_out);
 		thermapp->transfer_out = NULL;
+	} else {
+		thermapp->out_busy = 1;
 	}
 
 	thermapp->transfer_in = libusb_alloc_transfer(0);
@@ -281,10 +368,22 @@ thermapp_read_async(void *ctx)
 		thermapp->transfer_in = NULL;
 	}
 
+	int cancelled = 0;
 	while (thermapp->transfer_out || thermapp->transfer_in) {
-		ret = libusb_handle_events_completed(thermapp->ctx, &thermapp->complete);
-		if (ret) {
-			fprintf(stderr, "libusb_handle_events_completed: %s\n", libusb_strerror(ret));
+		// Wake up often enough to send the keep-alive on time;
+		// thermapp_set* and thermapp_close interrupt the wait.
+		struct timeval tv = { 0, THERMAPP_POLL_MS * 1000 };
+		ret = libusb_handle_events_timeout_completed(thermapp->ctx, &tv, &thermapp->complete);
+		if (!ret) {
+			// Transfers are cancelled and freed only here and in
+			// their callbacks, i.e. always on this thread.
+			if (atomic_load(&thermapp->stopping) && !cancelled) {
+				thermapp_cancel_async(thermapp);
+				cancelled = 1;
+			}
+			thermapp_submit_cfg(thermapp);
+		} else {
+			fprintf(stderr, "libusb_handle_events_timeout_completed: %s\n", libusb_strerror(ret));
 			if (ret == LIBUSB_ERROR_INTERRUPTED) /* stray signal */ {
 				continue;
 			} else {
@@ -316,17 +415,37 @@ thermapp_thread_create(ThermApp *thermapp)
 	return 0;
 }
 
+// Stop streaming: end the event thread and wake every thread waiting
+// for a frame, which then gets NULL / -1. The ThermApp stays valid until
+// thermapp_close, so callers can let their waiters leave first.
+void
+thermapp_stop(ThermApp *thermapp)
+{
+	// The event thread sees the flag, cancels the transfers and exits
+	atomic_store(&thermapp->stopping, 1);
+	if (thermapp->ctx) {
+		libusb_interrupt_event_handler(thermapp->ctx);
+	}
+
+	if (thermapp->started_read_async) {
+		pthread_join(thermapp->pthread_read_async, NULL);
+		thermapp->started_read_async = 0;
+
+		// Also if the event loop ended on an error
+		pthread_mutex_lock(&thermapp->mutex_getimage);
+		thermapp->complete = 1;
+		pthread_cond_broadcast(&thermapp->cond_getimage);
+		pthread_mutex_unlock(&thermapp->mutex_getimage);
+	}
+}
+
 int
 thermapp_close(ThermApp *thermapp)
 {
 	if (!thermapp)
 		return -1;
 
-	thermapp_cancel_async(thermapp, 0);
-
-	if (thermapp->started_read_async) {
-		pthread_join(thermapp->pthread_read_async, NULL);
-	}
+	thermapp_stop(thermapp);
 
 	if (thermapp->dev) {
 		libusb_release_interface(thermapp->dev, 0);
@@ -337,14 +456,44 @@ thermapp_close(ThermApp *thermapp)
 		libusb_exit(thermapp->ctx);
 	}
 
-	free(thermapp->data_done);
-	free(thermapp->data_in);
+	for (int i = 0; i < THERMAPP_POOL_SIZE; i++) {
+		free(thermapp->pool[i].packet);
+	}
+	free(thermapp->cfg_next);
 	free(thermapp->cfg);
 	free(thermapp);
 
 	return 0;
 }
 
+// Wait for the next frame; mutex_getimage must be held.
+// Returns the new frame_done, or NULL once streaming has stopped.
+static struct thermapp_frame *
+thermapp_wait_frame(ThermApp *thermapp)
+{
+	unsigned int seen = thermapp->nframes;
+
+	while (thermapp->nframes == seen && !thermapp->complete) {
+		pthread_cond_wait(&thermapp->cond_getimage, &thermapp->mutex_getimage);
+	}
+	if (thermapp->complete)
+		return NULL;
+
+	struct thermapp_frame *frame = thermapp->frame_done;
+	struct cfg_packet *header = &frame->packet->header;
+	thermapp->serial_num = header->serial_num_lo
+	                     | header->serial_num_hi << 16;
+	thermapp->hardware_ver = header->hardware_ver;
+	thermapp->firmware_ver = header->firmware_ver;
+	thermapp->temperature = header->temperature;
+	thermapp->frame_count = header->frame_count;
+	thermapp->header = *header;
+	thermapp->frame_mono = frame->mono;
+	thermapp->frame_utc = frame->utc;
+
+	return frame;
+}
+
 // This function for getting frame pixel data
 int
 thermapp_getImage(ThermApp *thermapp, int16_t *ImgData)
@@ -352,19 +501,12 @@ thermapp_getImage(ThermApp *thermapp, int16_t *ImgData)
 	int ret = 0;
 
 	pthread_mutex_lock(&thermapp->mutex_getimage);
-	pthread_cond_wait(&thermapp->cond_getimage, &thermapp->mutex_getimage);
 
-	if (thermapp->complete) {
+	struct thermapp_frame *frame = thermapp_wait_frame(thermapp);
+	if (!frame) {
 		ret = -1;
 	} else {
-		thermapp->serial_num = thermapp->data_done->header.serial_num_lo
-		                     | thermapp->data_done->header.serial_num_hi << 16;
-		thermapp->hardware_ver = thermapp->data_done->header.hardware_ver;
-		thermapp->firmware_ver = thermapp->data_done->header.firmware_ver;
-		thermapp->temperature = thermapp->data_done->header.temperature;
-		thermapp->frame_count = thermapp->data_done->header.frame_count;
-
-		memcpy(ImgData, thermapp->data_done->pixels_data, sizeof thermapp->data_done->pixels_data);
+		memcpy(ImgData, frame->packet->pixels_data, sizeof frame->packet->pixels_data);
 	}
 
 	pthread_mutex_unlock(&thermapp->mutex_getimage);
@@ -372,6 +514,46 @@ thermapp_getImage(ThermApp *thermapp, int16_t *ImgData)
 	return ret;
 }
 
+// Like thermapp_getImage, but hands out the pooled frame itself instead
+// of copying it. Every acquired frame must be given back with
+// thermapp_releaseFrame; while it is held the USB thread receives into
+// the other pool buffers, and drops frames if none is left.
+struct thermapp_frame *
+thermapp_acquireFrame(ThermApp *thermapp)
+{
+	pthread_mutex_lock(&thermapp->mutex_getimage);
+
+	struct thermapp_frame *frame = thermapp_wait_frame(thermapp);
+	if (frame) {
+		frame->refs++;
+	}
+
+	pthread_mutex_unlock(&thermapp->mutex_getimage);
+
+	return frame;
+}
+
+// Take another reference to an acquired frame, for handing it on to
+// another thread; each reference is dropped by thermapp_releaseFrame.
+void
+thermapp_refFrame(ThermApp *thermapp, struct thermapp_frame *frame)
+{
+	pthread_mutex_lock(&thermapp->mutex_getimage);
+	frame->refs++;
+	pthread_mutex_unlock(&thermapp->mutex_getimage);
+}
+
+void
+thermapp_releaseFrame(ThermApp *thermapp, struct thermapp_frame *frame)
+{
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&thermapp->mutex_getimage);
+	thermapp_unref(thermapp, frame);
+	pthread_mutex_unlock(&thermapp->mutex_getimage);
+}
+
 uint32_t
 thermapp_getSerialNumber(ThermApp *thermapp)
 {
@@ -392,10 +574,33 @@ thermapp_getFirmwareVersion(ThermApp *thermapp)
 
 //We don't know offset and quant value for temperature.
 //We use experimental value.
+static float
+thermapp_temperature_c(int16_t temperature)
+{
+	return (temperature - 14336) * 0.00652;
+}
+
 float
 thermapp_getTemperature(ThermApp *thermapp)
 {
-	return (thermapp->temperature - 14336) * 0.00652;
+	return thermapp_temperature_c(thermapp->temperature);
+}
+
+float
+thermapp_getFrameTemperature(const struct thermapp_frame *frame)
+{
+	return thermapp_temperature_c(frame->packet->header.temperature);
+}
+
+// Frames lost so far because every pool buffer was held by consumers
+unsigned int
+thermapp_getDropped(ThermApp *thermapp)
+{
+	pthread_mutex_lock(&thermapp->mutex_getimage);
+	unsigned int ndropped = thermapp->ndropped;
+	pthread_mutex_unlock(&thermapp->mutex_getimage);
+
+	return ndropped;
 }
 
 uint16_t
@@ -403,3 +608,78 @@ thermapp_getFrameCount(ThermApp *thermapp)
 {
 	return thermapp->frame_count;
 }
+
+// Header of the frame last returned by thermapp_getImage
+void
+thermapp_getHeader(ThermApp *thermapp, struct cfg_packet *header)
+{
+	*header = thermapp->header;
+}
+
+// Monotonic and UTC arrival time of the frame last returned by
+// thermapp_getImage, taken when its last USB transfer completed
+void
+thermapp_getFrameTime(ThermApp *thermapp, struct timespec *mono, struct timespec *utc)
+{
+	if (mono)
+		*mono = thermapp->frame_mono;
+	if (utc)
+		*utc = thermapp->frame_utc;
+}
+
+// Stage a change to the config packet. It is sent on the next pass of the
+// event loop, which is woken up for it; the packet in flight is untouched.
+static int
+thermapp_update_cfg(ThermApp *thermapp, uint16_t *field, uint16_t value)
+{
+	pthread_mutex_lock(&thermapp->mutex_cfg);
+	*field = value;
+	thermapp->cfg_dirty = 1;
+	pthread_mutex_unlock(&thermapp->mutex_cfg);
+
+	if (thermapp->ctx) {
+		libusb_interrupt_event_handler(thermapp->ctx);
+	}
+	return 0;
+}
+
+// AD5628 is a 12-bit DAC
+int
+thermapp_setOffset(ThermApp *thermapp, uint16_t VoutA)
+{
+	if (VoutA > 0x0fff)
+		return -1;
+	return thermapp_update_cfg(thermapp, &thermapp->cfg_next->VoutA, VoutA);
+}
+
+int
+thermapp_setGain(ThermApp *thermapp, uint16_t VoutC)
+{
+	if (VoutC > 0x0fff)
+		return -1;
+	return thermapp_update_cfg(thermapp, &thermapp->cfg_next->VoutC, VoutC);
+}
+
+int
+thermapp_setModes(ThermApp *thermapp, uint16_t modes)
+{
+	return thermapp_update_cfg(thermapp, &thermapp->cfg_next->modes, modes);
+}
+
+uint16_t
+thermapp_getOffset(ThermApp *thermapp)
+{
+	pthread_mutex_lock(&thermapp->mutex_cfg);
+	uint16_t VoutA = thermapp->cfg_next->VoutA;
+	pthread_mutex_unlock(&thermapp->mutex_cfg);
+	return VoutA;
+}
+
+uint16_t
+thermapp_getGain(ThermApp *thermapp)
+{
+	pthread_mutex_lock(&thermapp->mutex_cfg);
+	uint16_t VoutC = thermapp->cfg_next->VoutC;
+	pthread_mutex_unlock(&thermapp->mutex_cfg);
+	return VoutC;
+}
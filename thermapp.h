@@ -20,8 +20,10 @@
 #define THERMAPP_H_
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <libusb.h>
 
@@ -33,6 +35,19 @@
 #error TRANSFER_SIZE must be a multiple of 512
 #endif
 
+// The event thread wakes up at least this often to send config packets
+#define THERMAPP_POLL_MS 100
+
+// Config packets are only sent when changed, plus this keep-alive. The
+// keep-alive is checked once per event poll, so it is effectively rounded
+// up to a multiple of THERMAPP_POLL_MS; any value up to THERMAPP_POLL_MS,
+// including 0, resends on every poll (10 times a second).
+#define CFG_KEEPALIVE_MS 1000
+
+// Packet buffers shared between the USB thread and frame consumers:
+// one being filled, the latest frame, and spares for frames held by callers
+#define THERMAPP_POOL_SIZE 16
+
 #define FRAME_WIDTH  384
 #define FRAME_HEIGHT 288
 #define PIXELS_DATA_SIZE (FRAME_WIDTH * FRAME_HEIGHT)
@@ -76,6 +91,16 @@ struct thermapp_packet {
 	int16_t pixels_data[PIXELS_DATA_SIZE];
 };
 
+// A pooled frame, handed out by thermapp_acquireFrame without copying.
+// The packet stays valid until thermapp_releaseFrame.
+struct thermapp_frame {
+	struct thermapp_packet *packet;
+	struct timespec mono;		// arrival time, CLOCK_MONOTONIC
+	struct timespec utc;		// arrival time, CLOCK_REALTIME
+	int refs;
+	struct thermapp_frame *next_free;
+};
+
 typedef struct thermapp {
 	libusb_context *ctx;
 	libusb_device_handle *dev;
@@ -87,21 +112,38 @@ typedef struct thermapp {
 	pthread_mutex_t mutex_getimage;
 	pthread_cond_t cond_getimage;
 	int complete;
+	unsigned int nframes;		// frames completed so far
+	unsigned int ndropped;		// frames lost because the pool was empty,
+					// under mutex_getimage
 
-	struct cfg_packet *cfg;
+	struct cfg_packet *cfg;		// owned by the event thread, sent as is
+	struct cfg_packet *cfg_next;	// staged by the setters
+	pthread_mutex_t mutex_cfg;
+	int cfg_dirty;
+	int cfg_keepalive_ms;		// >= 0, see CFG_KEEPALIVE_MS
+	int out_busy;			// transfer_out submitted
+	atomic_int stopping;		// set by thermapp_close
+	struct timespec out_last;
+	struct thermapp_frame pool[THERMAPP_POOL_SIZE];
+	struct thermapp_frame *frame_free;
+	struct thermapp_frame *frame_in;	// being received into data_in
+	struct thermapp_frame *frame_done;	// latest complete frame
 	struct thermapp_packet *data_in;
-	struct thermapp_packet *data_done;
 	uint32_t serial_num;
 	uint16_t hardware_ver;
 	uint16_t firmware_ver;
 	int16_t temperature;
 	uint16_t frame_count;
+	struct cfg_packet header;	// header of the last frame returned
+	struct timespec frame_mono;
+	struct timespec frame_utc;
 } ThermApp;
 
 
 ThermApp *thermapp_open(void);
 int thermapp_usb_connect(ThermApp *thermapp);
 int thermapp_thread_create(ThermApp *thermapp);
+void thermapp_stop(ThermApp *thermapp);
 int thermapp_close(ThermApp *thermapp);
 
 int thermapp_getImage(ThermApp *thermapp, int16_t *ImgData);
@@ -110,5 +152,19 @@ uint16_t thermapp_getHardwareVersion(ThermApp *thermapp);
 uint16_t thermapp_getFirmwareVersion(ThermApp *thermapp);
 float thermapp_getTemperature(ThermApp *thermapp);
 uint16_t thermapp_getFrameCount(ThermApp *thermapp);
+unsigned int thermapp_getDropped(ThermApp *thermapp);
+void thermapp_getHeader(ThermApp *thermapp, struct cfg_packet *header);
+void thermapp_getFrameTime(ThermApp *thermapp, struct timespec *mono, struct timespec *utc);
+
+struct thermapp_frame *thermapp_acquireFrame(ThermApp *thermapp);
+void thermapp_refFrame(ThermApp *thermapp, struct thermapp_frame *frame);
+void thermapp_releaseFrame(ThermApp *thermapp, struct thermapp_frame *frame);
+float thermapp_getFrameTemperature(const struct thermapp_frame *frame);
+
+int thermapp_setOffset(ThermApp *thermapp, uint16_t VoutA);
+int thermapp_setGain(ThermApp *thermapp, uint16_t VoutC);
+int thermapp_setModes(ThermApp *thermapp, uint16_t modes);
+uint16_t thermapp_getOffset(ThermApp *thermapp);
+uint16_t thermapp_getGain(ThermApp *thermapp);
 
 #endif /* THERMAPP_H_ */
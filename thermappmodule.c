@@ -0,0 +1,499 @@
+/* Python bindings for thermapp.c
+ *
+ *     import numpy as np, thermapp
+ *     cam = thermapp.Camera()
+ *     with cam.frame() as f:
+ *         img = np.asarray(f)        # int16 (288, 384), no copy
+ *         ...
+ *
+ * Frames are the library's pooled USB packet buffers, exposed through the
+ * buffer protocol. A frame must be released (explicitly, by leaving the
+ * with block, or by deleting it) once its array views are gone, otherwise
+ * the pool runs dry and the camera starts dropping frames.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+
+#include "thermapp.h"
+
+// Frames Python may hold at once. The camera needs a free pool buffer to
+// receive into: with none left every new frame is dropped and frame()
+// would wait forever, so refuse before that happens.
+#define CAMERA_MAX_FRAMES (THERMAPP_POOL_SIZE - 2)
+
+typedef struct {
+	PyObject_HEAD
+	ThermApp *therm;
+	int outstanding;	// frames not yet released
+	int busy;		// threads waiting in frame() without the GIL
+	int closing;		// close() is waiting for them to leave
+} CameraObject;
+
+typedef struct {
+	PyObject_HEAD
+	CameraObject *camera;
+	struct thermapp_frame *frame;
+	int exports;		// live buffer views
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+} FrameObject;
+
+static PyTypeObject CameraType;
+static PyTypeObject FrameType;
+
+/* Frame */
+
+static int
+Frame_release_frame(FrameObject *self)
+{
+	if (!self->frame)
+		return 0;
+	if (self->exports) {
+		PyErr_SetString(PyExc_BufferError,
+		                "frame is still in use by an array or memoryview");
+		return -1;
+	}
+	thermapp_releaseFrame(self->camera->therm, self->frame);
+	self->frame = NULL;
+	self->camera->outstanding--;
+	return 0;
+}
+
+static void
+Frame_dealloc(FrameObject *self)
+{
+	if (self->frame) {
+		thermapp_releaseFrame(self->camera->therm, self->frame);
+		self->camera->outstanding--;
+	}
+	Py_XDECREF(self->camera);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+Frame_getbuffer(FrameObject *self, Py_buffer *view, int flags)
+{
+	if (!self->frame) {
+		PyErr_SetString(PyExc_ValueError, "frame has been released");
+		view->obj = NULL;
+		return -1;
+	}
+	if (flags & PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "frames are read-only");
+		view->obj = NULL;
+		return -1;
+	}
+
+	view->buf = self->frame->packet->pixels_data;
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->len = sizeof self->frame->packet->pixels_data;
+	view->readonly = 1;
+	view->itemsize = sizeof(int16_t);
+	view->format = (flags & PyBUF_FORMAT) ? "h" : NULL;
+	// Without PyBUF_ND the consumer only gets a flat buffer of len bytes
+	if (flags & PyBUF_ND) {
+		view->ndim = 2;
+		view->shape = self->shape;
+		view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+	} else {
+		view->ndim = 1;
+		view->shape = NULL;
+		view->strides = NULL;
+	}
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	self->exports++;
+	return 0;
+}
+
+static void
+Frame_releasebuffer(FrameObject *self, Py_buffer *view)
+{
+	self->exports--;
+}
+
+static PyBufferProcs Frame_as_buffer = {
+	.bf_getbuffer = (getbufferproc)Frame_getbuffer,
+	.bf_releasebuffer = (releasebufferproc)Frame_releasebuffer,
+};
+
+static PyObject *
+Frame_release(FrameObject *self, PyObject *Py_UNUSED(ignored))
+{
+	if (Frame_release_frame(self))
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+Frame_enter(FrameObject *self, PyObject *Py_UNUSED(ignored))
+{
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+static PyObject *
+Frame_exit(FrameObject *self, PyObject *args)
+{
+	if (Frame_release_frame(self))
+		return NULL;
+	Py_RETURN_FALSE;
+}
+
+static int
+Frame_check(FrameObject *self)
+{
+	if (!self->frame) {
+		PyErr_SetString(PyExc_ValueError, "frame has been released");
+		return -1;
+	}
+	return 0;
+}
+
+static PyObject *
+Frame_get_temperature(FrameObject *self, void *closure)
+{
+	if (Frame_check(self))
+		return NULL;
+	return PyFloat_FromDouble(thermapp_getFrameTemperature(self->frame));
+}
+
+static PyObject *
+Frame_get_frame_count(FrameObject *self, void *closure)
+{
+	if (Frame_check(self))
+		return NULL;
+	return PyLong_FromLong(self->frame->packet->header.frame_count);
+}
+
+static PyObject *
+Frame_get_utc(FrameObject *self, void *closure)
+{
+	if (Frame_check(self))
+		return NULL;
+	return PyFloat_FromDouble(self->frame->utc.tv_sec + self->frame->utc.tv_nsec * 1e-9);
+}
+
+static PyObject *
+Frame_get_monotonic(FrameObject *self, void *closure)
+{
+	if (Frame_check(self))
+		return NULL;
+	return PyFloat_FromDouble(self->frame->mono.tv_sec + self->frame->mono.tv_nsec * 1e-9);
+}
+
+static PyObject *
+Frame_get_header(FrameObject *self, void *closure)
+{
+	if (Frame_check(self))
+		return NULL;
+	return PyBytes_FromStringAndSize((const char *)&self->frame->packet->header,
+	                                 sizeof self->frame->packet->header);
+}
+
+static PyMethodDef Frame_methods[] = {
+	{"release", (PyCFunction)Frame_release, METH_NOARGS,
+	 "Give the buffer back to the camera. Fails while array views exist."},
+	{"__enter__", (PyCFunction)Frame_enter, METH_NOARGS, NULL},
+	{"__exit__", (PyCFunction)Frame_exit, METH_VARARGS, NULL},
+	{NULL}
+};
+
+static PyGetSetDef Frame_getset[] = {
+	{"temperature", (getter)Frame_get_temperature, NULL, "Detector temperature [C]", NULL},
+	{"frame_count", (getter)Frame_get_frame_count, NULL, "Camera frame counter", NULL},
+	{"utc", (getter)Frame_get_utc, NULL, "Arrival time, seconds since the epoch", NULL},
+	{"monotonic", (getter)Frame_get_monotonic, NULL, "Arrival time, CLOCK_MONOTONIC seconds", NULL},
+	{"header", (getter)Frame_get_header, NULL, "Raw cfg_packet header bytes", NULL},
+	{NULL}
+};
+
+static PyTypeObject FrameType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "thermapp.Frame",
+	.tp_doc = "One camera frame, int16 pixels exported via the buffer protocol",
+	.tp_basicsize = sizeof(FrameObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_dealloc = (destructor)Frame_dealloc,
+	.tp_as_buffer = &Frame_as_buffer,
+	.tp_methods = Frame_methods,
+	.tp_getset = Frame_getset,
+};
+
+/* Camera */
+
+static int
+Camera_check(CameraObject *self)
+{
+	if (!self->therm) {
+		PyErr_SetString(PyExc_ValueError, "camera is closed");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+Camera_init(CameraObject *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {NULL};
+	struct thermapp_frame *frame;
+	int err;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+		return -1;
+	if (self->therm) {
+		PyErr_SetString(PyExc_RuntimeError, "camera already open");
+		return -1;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	self->therm = thermapp_open();
+	err = !self->therm
+	   || thermapp_usb_connect(self->therm)
+	   || thermapp_thread_create(self->therm);
+	// Discard 1st frame, it usually has the header repeated twice
+	// and the data shifted into the pad by a corresponding amount.
+	frame = err ? NULL : thermapp_acquireFrame(self->therm);
+	thermapp_releaseFrame(self->therm, frame);
+	if (!frame && self->therm) {
+		thermapp_close(self->therm);
+		self->therm = NULL;
+	}
+	Py_END_ALLOW_THREADS
+
+	if (!self->therm) {
+		PyErr_SetString(PyExc_OSError, "cannot open ThermApp camera");
+		return -1;
+	}
+	return 0;
+}
+
+static PyObject *
+Camera_close(CameraObject *self, PyObject *Py_UNUSED(ignored))
+{
+	if (self->outstanding) {
+		PyErr_SetString(PyExc_RuntimeError, "release all frames before closing");
+		return NULL;
+	}
+	if (self->therm) {
+		ThermApp *therm = self->therm;
+		self->therm = NULL;
+		self->closing = 1;
+
+		// Wakes the threads blocked in frame(); they need the GIL to
+		// leave, so the ThermApp is freed only once busy drops to 0.
+		Py_BEGIN_ALLOW_THREADS
+		thermapp_stop(therm);
+		Py_END_ALLOW_THREADS
+		while (self->busy) {
+			Py_BEGIN_ALLOW_THREADS
+			usleep(1000);
+			Py_END_ALLOW_THREADS
+		}
+
+		Py_BEGIN_ALLOW_THREADS
+		thermapp_close(therm);
+		Py_END_ALLOW_THREADS
+		self->closing = 0;
+	}
+	Py_RETURN_NONE;
+}
+
+static void
+Camera_dealloc(CameraObject *self)
+{
+	// Frames keep their camera alive, so none is outstanding here
+	if (self->therm) {
+		thermapp_close(self->therm);
+	}
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+Camera_frame(CameraObject *self, PyObject *Py_UNUSED(ignored))
+{
+	struct thermapp_frame *frame;
+	ThermApp *therm = self->therm;
+
+	if (Camera_check(self))
+		return NULL;
+
+	if (self->outstanding + self->busy >= CAMERA_MAX_FRAMES) {
+		PyErr_Format(PyExc_RuntimeError,
+		             "%d frames held, release frames first", CAMERA_MAX_FRAMES);
+		return NULL;
+	}
+
+	FrameObject *f = PyObject_New(FrameObject, &FrameType);
+	if (!f)
+		return NULL;
+
+	self->busy++;
+	Py_BEGIN_ALLOW_THREADS
+	frame = thermapp_acquireFrame(therm);
+	Py_END_ALLOW_THREADS
+	self->busy--;
+
+	// close() was called meanwhile and is waiting for us
+	if (self->closing) {
+		thermapp_releaseFrame(therm, frame);
+		frame = NULL;
+	}
+
+	if (!frame) {
+		f->frame = NULL;
+		f->camera = NULL;
+		Py_DECREF(f);
+		PyErr_SetString(PyExc_OSError, "camera stopped streaming");
+		return NULL;
+	}
+
+	Py_INCREF(self);
+	f->camera = self;
+	f->frame = frame;
+	f->exports = 0;
+	f->shape[0] = FRAME_HEIGHT;
+	f->shape[1] = FRAME_WIDTH;
+	f->strides[0] = FRAME_WIDTH * sizeof(int16_t);
+	f->strides[1] = sizeof(int16_t);
+	self->outstanding++;
+	return (PyObject *)f;
+}
+
+static PyObject *
+Camera_enter(CameraObject *self, PyObject *Py_UNUSED(ignored))
+{
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+static PyObject *
+Camera_exit(CameraObject *self, PyObject *args)
+{
+	PyObject *ret = Camera_close(self, NULL);
+	if (!ret)
+		return NULL;
+	Py_DECREF(ret);
+	Py_RETURN_FALSE;
+}
+
+static PyObject *
+Camera_get_serial(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyLong_FromUnsignedLong(thermapp_getSerialNumber(self->therm));
+}
+
+static PyObject *
+Camera_get_temperature(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyFloat_FromDouble(thermapp_getTemperature(self->therm));
+}
+
+static PyObject *
+Camera_get_frame_count(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyLong_FromLong(thermapp_getFrameCount(self->therm));
+}
+
+static PyObject *
+Camera_get_hardware_version(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyLong_FromLong(thermapp_getHardwareVersion(self->therm));
+}
+
+static PyObject *
+Camera_get_firmware_version(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyLong_FromLong(thermapp_getFirmwareVersion(self->therm));
+}
+
+static PyObject *
+Camera_get_dropped(CameraObject *self, void *closure)
+{
+	if (Camera_check(self))
+		return NULL;
+	return PyLong_FromUnsignedLong(thermapp_getDropped(self->therm));
+}
+
+static PyMethodDef Camera_methods[] = {
+	{"frame", (PyCFunction)Camera_frame, METH_NOARGS,
+	 "Wait for the next frame and return it without copying."},
+	{"close", (PyCFunction)Camera_close, METH_NOARGS,
+	 "Stop streaming and close the camera."},
+	{"__enter__", (PyCFunction)Camera_enter, METH_NOARGS, NULL},
+	{"__exit__", (PyCFunction)Camera_exit, METH_VARARGS, NULL},
+	{NULL}
+};
+
+static PyGetSetDef Camera_getset[] = {
+	{"serial", (getter)Camera_get_serial, NULL, "Serial number", NULL},
+	{"temperature", (getter)Camera_get_temperature, NULL, "Detector temperature of the last frame [C]", NULL},
+	{"frame_count", (getter)Camera_get_frame_count, NULL, "Frame counter of the last frame", NULL},
+	{"hardware_version", (getter)Camera_get_hardware_version, NULL, "Hardware version", NULL},
+	{"firmware_version", (getter)Camera_get_firmware_version, NULL, "Firmware version", NULL},
+	{"dropped", (getter)Camera_get_dropped, NULL, "Frames dropped because all buffers were held", NULL},
+	{NULL}
+};
+
+static PyTypeObject CameraType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "thermapp.Camera",
+	.tp_doc = "Therm-App camera, streaming from construction until close()",
+	.tp_basicsize = sizeof(CameraObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)Camera_init,
+	.tp_dealloc = (destructor)Camera_dealloc,
+	.tp_methods = Camera_methods,
+	.tp_getset = Camera_getset,
+};
+
+static struct PyModuleDef thermappmodule = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "thermapp",
+	.m_doc = "Zero-copy access to the Therm-App camera stream",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC
+PyInit_thermapp(void)
+{
+	PyObject *m;
+
+	if (PyType_Ready(&CameraType) < 0 || PyType_Ready(&FrameType) < 0)
+		return NULL;
+
+	m = PyModule_Create(&thermappmodule);
+	if (!m)
+		return NULL;
+
+	Py_INCREF(&CameraType);
+	if (PyModule_AddObject(m, "Camera", (PyObject *)&CameraType) < 0) {
+		Py_DECREF(&CameraType);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_INCREF(&FrameType);
+	if (PyModule_AddObject(m, "Frame", (PyObject *)&FrameType) < 0) {
+		Py_DECREF(&FrameType);
+		Py_DECREF(m);
+		return NULL;
+	}
+	PyModule_AddIntConstant(m, "FRAME_WIDTH", FRAME_WIDTH);
+	PyModule_AddIntConstant(m, "FRAME_HEIGHT", FRAME_HEIGHT);
+
+	return m;
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fitsio.h"
+#include "thermfits.h"
+
+#define DETNAM "ThermApp"
+#define WAVELEN "7.5 -14 micron"
+#define PIXSZ 17
+#define FRAMERAT 8.7
+
+/* This function creates the output file name of a science frame based 
+ * on the current UTC */
+int get_science_fname(char *opfname)
+{
+    time_t now = time(&now);
+    
+    if (now == -1) {
+        puts("The time() function failed");
+    }
+        
+    struct tm *ptm = gmtime(&now);
+    
+    if (ptm == NULL) {
+        puts("The gmtime() function failed");
+    }    
+    
+    strftime(opfname, BUF_LEN, "thermapp_%Y%m%d_%H%M%S.fits", ptm);
+    return 0;
+}
+
+/* This function creates the output file name of a dark frame based 
+ * on the current UTC and frame counter */
+int get_dark_fname(char *opfname, int framecount)
+{
+    char fc[BUF_LEN];
+    time_t now = time(&now);
+    
+    if (now == -1) {
+        puts("The time() function failed");
+    }
+        
+    struct tm *ptm = gmtime(&now);
+    
+    if (ptm == NULL) {
+        puts("The gmtime() function failed");
+    }    
+    
+    strftime(opfname, BUF_LEN, "thermapp_%Y%m%d_%H%M", ptm);
+
+    sprintf(fc,"_dark%02d.fits",framecount+1);
+    strcat(opfname, fc);
+    return 0;
+}
+
+/* This function creates the output file name of one frame of a burst
+ * based on the UTC of the trigger, including milliseconds */
+int get_burst_fname(char *opfname, const struct timespec *trigger, int index)
+{
+    char fc[BUF_LEN];
+    struct tm tm;
+
+    if (gmtime_r(&trigger->tv_sec, &tm) == NULL) {
+        puts("The gmtime_r() function failed");
+        return -1;
+    }
+
+    strftime(opfname, BUF_LEN, "thermapp_%Y%m%d_%H%M%S", &tm);
+
+    sprintf(fc,"%03ld_burst%03d.fits",trigger->tv_nsec / 1000000,index);
+    strcat(opfname, fc);
+    return 0;
+}
+
+
+/* This function creates the output file name of the radiometric
+ * image that goes with a science frame */
+int get_radiometric_fname(char *opfname, const char *science)
+{
+    size_t len = strlen(science);
+
+    if (len > 5 && strcmp(science + len - 5, ".fits") == 0) {
+        len -= 5;
+    }
+    snprintf(opfname, BUF_LEN, "%.*s_temp.fits", (int)len, science);
+    return 0;
+}
+
+
+/* This function appends a SOURCES binary table, positions in 1-based
+ * FITS pixel coordinates of the image */
+static int write_fits_sources(fitsfile *fptr, const struct detect_source *src,
+                              int nsrc, int *status)
+{
+	char *ttype[] = { "X_IMAGE", "Y_IMAGE", "FLUX", "PEAK", "NPIX" };
+	char *tform[] = { "1E", "1E", "1E", "1E", "1J" };
+	char *tunit[] = { "pixel", "pixel", "count", "count", "" };
+	float col[DETECT_MAX_SOURCES];
+	int npixcol[DETECT_MAX_SOURCES];
+	int ii;
+
+	if (nsrc > DETECT_MAX_SOURCES)
+		nsrc = DETECT_MAX_SOURCES;
+
+	if ( fits_create_tbl(fptr, BINARY_TBL, nsrc, 5, ttype, tform, tunit,
+				"SOURCES", status) )
+		return( *status );
+
+	for (ii = 0; ii < nsrc; ii++) col[ii] = src[ii].x + 1;
+	fits_write_col(fptr, TFLOAT, 1, 1, 1, nsrc, col, status);
+	for (ii = 0; ii < nsrc; ii++) col[ii] = src[ii].y + 1;
+	fits_write_col(fptr, TFLOAT, 2, 1, 1, nsrc, col, status);
+	for (ii = 0; ii < nsrc; ii++) col[ii] = src[ii].flux;
+	fits_write_col(fptr, TFLOAT, 3, 1, 1, nsrc, col, status);
+	for (ii = 0; ii < nsrc; ii++) col[ii] = src[ii].peak;
+	fits_write_col(fptr, TFLOAT, 4, 1, 1, nsrc, col, status);
+	for (ii = 0; ii < nsrc; ii++) npixcol[ii] = src[ii].npix;
+	fits_write_col(fptr, TINT, 5, 1, 1, nsrc, npixcol, status);
+
+	return( *status );
+}
+
+/* This function writes the keywords common to all images: instrument,
+ * detector temperature, time of observation (UTC, and CLOCK_MONOTONIC
+ * when mono is given) and subframe geometry */
+static int write_fits_keys(fitsfile *fptr, const Binning *bn, char *imgtyp,
+                           float TempC, const struct timespec *obs,
+                           const struct timespec *mono, int *status)
+{
+	int pixsz = PIXSZ;
+	int binning = bn->factor;
+	int xorg = bn->x0, yorg = bn->y0;
+	char dateobs[BUF_LEN];
+	struct tm tm;
+	double framerat = FRAMERAT;
+
+	if ( fits_write_date(fptr, status) )
+		return( *status );
+	if ( fits_update_key(fptr, TSTRING, "INSTRUME", &DETNAM, 
+				"Detector", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TSTRING, "WAVELEN", &WAVELEN, 
+				"Microns", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TINT, "PIXSZ", &pixsz, 
+				"Pixel size in microns", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TDOUBLE, "FRAMERAT", &framerat, 
+				"Frame rate in HZ", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TSTRING, "IMGTYPE", imgtyp, 
+				"Science or Dark image", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TFLOAT, "DET_TEMP", &TempC, 
+				"Temperature [C]", status) )
+		return ( *status );
+	if ( obs && gmtime_r(&obs->tv_sec, &tm) ) {
+		strftime(dateobs, sizeof dateobs, "%Y-%m-%dT%H:%M:%S", &tm);
+		sprintf(dateobs + strlen(dateobs), ".%03ld", obs->tv_nsec / 1000000);
+		if ( fits_update_key(fptr, TSTRING, "DATE-OBS", dateobs, 
+					"UTC arrival of the frame", status) )
+			return ( *status );
+	}
+	if ( mono ) {
+		double monotime = mono->tv_sec + mono->tv_nsec * 1e-9;
+		if ( fits_update_key(fptr, TDOUBLE, "MONOTIME", &monotime, 
+					"CLOCK_MONOTONIC arrival of the frame [s]", status) )
+			return ( *status );
+	}
+
+	if ( fits_update_key(fptr, TINT, "XBINNING", &binning, 
+				"Binning factor in width", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TINT, "YBINNING", &binning, 
+				"Binning factor in height", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TINT, "XORGSUBF", &xorg, 
+				"Subframe X position in unbinned pixels", status) )
+		return ( *status );
+	if ( fits_update_key(fptr, TINT, "YORGSUBF", &yorg, 
+				"Subframe Y position in unbinned pixels", status) )
+		return ( *status );
+
+	return( *status );
+}
+
+int write_fits_fname(int16_t *frame_arr, const Binning *bn, char *fname, char *imgtyp,
+                     float TempC, const struct timespec *obs,
+                     const struct timespec *mono,
+                     const struct detect_source *src, int nsrc)
+{
+	int status = 0;        /* initialize status before calling fitsio  */
+	int bitpix =  16;      /* 16-bit short signed integer pixel values */
+	long fpixel = 1;                           /* first pixel to write */
+	long naxis =   2;                           /* 2-dimensional image */
+	long naxes[2] = {bn->width, bn->height};
+	long npix = naxes[0] * naxes[1];
+
+	fitsfile *fptr;                        /* pointer to the FITS file */
+	
+	if ( fits_create_file(&fptr, fname, &status) )      /* create FITS */
+		return( status );
+	
+	/* Write the required keywords for the primary array image         */
+	if ( fits_create_img(fptr,  bitpix, naxis, naxes, &status) )
+		return( status );
+	if ( write_fits_keys(fptr, bn, imgtyp, TempC, obs, mono, &status) )
+		return( status );
+
+	/* Write the int16_t array directly as 16-bit shorts               */
+	if ( fits_write_img(fptr, TSHORT, fpixel, npix, frame_arr, &status) )
+		return( status );
+
+	/* Sources found in the live frame go into a binary table extension */
+	if ( src && write_fits_sources(fptr, src, nsrc, &status) )
+		return( status );
+	fits_close_file(fptr, &status);                  /* close the file */
+	fits_report_error(stderr, status); /* print out any error messages */
+	
+	return status;
+}
+
+/* This function writes a scene temperature image in deg C, either as
+ * 32-bit floats (temp_arr is float *, NaN where the model does not
+ * apply) or as 16-bit integers scaled by BSCALE/BZERO (temp_arr is
+ * int16_t *, BLANK where the model does not apply). rad_temp is the
+ * detector temperature the conversion table was built for */
+int write_fits_radiometric(const void *temp_arr, int scaled, const Binning *bn,
+                           char *fname, float TempC, const struct timespec *obs,
+                           const struct timespec *mono,
+                           const Radiometry *rad, float rad_temp)
+{
+	int status = 0;
+	int bitpix = scaled ? SHORT_IMG : FLOAT_IMG;
+	long fpixel = 1;
+	long naxis = 2;
+	long naxes[2] = {bn->width, bn->height};
+	long npix = naxes[0] * naxes[1];
+	double bscale = RADIOMETRY_BSCALE, bzero = RADIOMETRY_BZERO;
+	int blank = RADIOMETRY_BLANK;
+	float lut_temp = rad_temp;
+	double emissivity = rad->emissivity;
+	double reflected = rad->reflected;
+
+	fitsfile *fptr;
+
+	if ( fits_create_file(&fptr, fname, &status) )
+		return( status );
+	if ( fits_create_img(fptr, bitpix, naxis, naxes, &status) )
+		return( status );
+	if ( write_fits_keys(fptr, bn, "RADIOMETRIC", TempC, obs, mono, &status) )
+		return( status );
+
+	if ( fits_update_key(fptr, TSTRING, "BUNIT", "Celsius", 
+				"Scene temperature", &status) )
+		return ( status );
+	if ( fits_update_key(fptr, TSTRING, "RADCAL", (char *)rad->calfile, 
+				"Radiometric calibration file", &status) )
+		return ( status );
+	if ( fits_update_key(fptr, TFLOAT, "RADTEMP", &lut_temp, 
+				"Detector temperature of the calibration [C]", &status) )
+		return ( status );
+	if ( fits_update_key(fptr, TDOUBLE, "EMISSIV", &emissivity, 
+				"Assumed emissivity", &status) )
+		return ( status );
+	if ( fits_update_key(fptr, TDOUBLE, "REFLTEMP", &reflected, 
+				"Reflected temperature [C]", &status) )
+		return ( status );
+
+	if ( scaled ) {
+		if ( fits_update_key(fptr, TDOUBLE, "BSCALE", &bscale, 
+					"deg C = BZERO + BSCALE * value", &status) )
+			return ( status );
+		if ( fits_update_key(fptr, TDOUBLE, "BZERO", &bzero, 
+					NULL, &status) )
+			return ( status );
+		if ( fits_update_key(fptr, TINT, "BLANK", &blank, 
+					"No valid temperature", &status) )
+			return ( status );
+		/* The values are already scaled, store them as they are   */
+		fits_set_bscale(fptr, 1.0, 0.0, &status);
+		if ( fits_write_img(fptr, TSHORT, fpixel, npix, (void *)temp_arr, &status) )
+			return( status );
+	} else {
+		if ( fits_write_img(fptr, TFLOAT, fpixel, npix, (void *)temp_arr, &status) )
+			return( status );
+	}
+
+	fits_close_file(fptr, &status);
+	fits_report_error(stderr, status);
+
+	return status;
+}
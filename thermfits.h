@@ -0,0 +1,28 @@
+#ifndef THERMFITS_H_
+#define THERMFITS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "bin.h"
+#include "detect.h"
+#include "radiometry.h"
+
+#define BUF_LEN 256
+
+//int write_fits_fname(int16_t *frame_arr, char *fname);
+//int write_fits_fname(int16_t *frame_arr, char *fname, char *imgtyp);
+int write_fits_fname(int16_t *frame_arr, const Binning *bn, char *fname, char *imgtyp,
+                     float TempC, const struct timespec *obs,
+                     const struct timespec *mono,
+                     const struct detect_source *src, int nsrc);
+int write_fits_radiometric(const void *temp_arr, int scaled, const Binning *bn,
+                           char *fname, float TempC, const struct timespec *obs,
+                           const struct timespec *mono,
+                           const Radiometry *rad, float rad_temp);
+int get_science_fname(char *opfname);
+int get_dark_fname(char *opfname, int framecount);
+int get_burst_fname(char *opfname, const struct timespec *trigger, int index);
+int get_radiometric_fname(char *opfname, const char *science);
+
+#endif /* THERMFITS_H_ */
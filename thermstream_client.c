@@ -0,0 +1,283 @@
+// Subscriber for the astrotherm frame server (astrotherm -l port [-u]).
+// Receives frames over TCP, or over UDP with -u, and prints the frame
+// rate, lost frames/datagrams and latency once a second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "stream.h"
+
+#define FRAME_BYTES (sizeof(struct stream_header) + sizeof(struct thermapp_packet))
+
+struct stats {
+	unsigned long frames;
+	unsigned long lost;		// frames never seen at all
+	unsigned long incomplete;	// UDP frames with datagrams missing
+	unsigned long lost_dgrams;
+	unsigned long long bytes;
+	double latency;			// sum, seconds
+	struct timespec start;
+};
+
+static double
+elapsed(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: thermstream_client [options] host [port]\n"
+	       "  -u          receive over UDP instead of TCP\n"
+	       "  -n N        exit after N frames\n"
+	       "  -o file     write the pixels of the last frame to file (raw int16)\n");
+}
+
+// Account for one complete frame; buf holds the header and the packet.
+static void
+frame_done(struct stats *s, const char *buf, uint32_t *last)
+{
+	const struct stream_header *hdr = (const struct stream_header *)buf;
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (*last && hdr->frame != *last + 1) {
+		s->lost += hdr->frame - *last - 1;
+	}
+	*last = hdr->frame;
+	s->frames++;
+	s->bytes += FRAME_BYTES;
+	s->latency += (now.tv_sec - hdr->utc_sec) + (now.tv_nsec - hdr->utc_nsec) * 1e-9;
+}
+
+static void
+report(struct stats *s)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double dt = elapsed(&s->start, &now);
+	if (dt < 1.0)
+		return;
+	printf("%6.1f fps %7.2f MB/s  lost %lu frames, %lu incomplete, %lu datagrams  latency %.2f ms\n",
+	       s->frames / dt, s->bytes / dt / 1e6, s->lost, s->incomplete, s->lost_dgrams,
+	       s->frames ? s->latency / s->frames * 1e3 : 0.0);
+	fflush(stdout);
+	s->frames = s->bytes = 0;
+	s->latency = 0;
+	s->start = now;
+}
+
+static int
+check_header(const struct stream_header *hdr)
+{
+	if (hdr->magic != STREAM_MAGIC || hdr->version != STREAM_VERSION
+	 || hdr->size != sizeof *hdr || hdr->packet_size != sizeof(struct thermapp_packet)) {
+		fprintf(stderr, "not an astrotherm stream, or a different version\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+read_full(int fd, char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				perror("read");
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+receive_tcp(int fd, char *buf, long nframes, struct stats *s)
+{
+	uint32_t last = 0;
+	int have = 0;
+
+	for (long i = 0; nframes <= 0 || i < nframes; i++) {
+		if (read_full(fd, buf, FRAME_BYTES))
+			break;
+		if (check_header((struct stream_header *)buf))
+			return -1;
+		have = 1;
+		frame_done(s, buf, &last);
+		report(s);
+	}
+	return have ? 0 : -1;
+}
+
+static int
+receive_udp(int fd, const struct sockaddr *srv, socklen_t srvlen,
+            char *buf, long nframes, struct stats *s)
+{
+	char dgram[sizeof(struct stream_datagram) + STREAM_UDP_CHUNK];
+	const struct stream_datagram *dg = (const struct stream_datagram *)dgram;
+	struct timespec hello = {0}, now;
+	uint32_t last = 0, seq = 0, cur = 0;
+	int have = 0, got = 0, started = 0;
+	long done = 0;
+
+	while (nframes <= 0 || done < nframes) {
+		// (Re)subscribe every second, the server forgets silent peers
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (elapsed(&hello, &now) >= 1.0) {
+			if (sendto(fd, "hello", 5, 0, srv, srvlen) < 0) {
+				perror("sendto");
+				return -1;
+			}
+			hello = now;
+		}
+
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+		ssize_t n = recv(fd, dgram, sizeof dgram, 0);
+		if (n < (ssize_t)sizeof *dg || dg->magic != STREAM_MAGIC)
+			continue;
+
+		if (started && dg->seq != seq + 1) {
+			s->lost_dgrams += dg->seq - seq - 1;
+		}
+		seq = dg->seq;
+		started = 1;
+
+		if (dg->frame != cur) {
+			// Counted once, as incomplete rather than lost
+			if (got) {
+				s->incomplete++;
+				last = cur;
+			}
+			cur = dg->frame;
+			got = 0;
+		}
+		size_t off = (size_t)dg->chunk * STREAM_UDP_CHUNK;
+		size_t len = n - sizeof *dg;
+		if (off + len > FRAME_BYTES)
+			continue;
+		memcpy(buf + off, dgram + sizeof *dg, len);
+		if (++got == dg->nchunks) {
+			if (check_header((struct stream_header *)buf))
+				return -1;
+			frame_done(s, buf, &last);
+			have = 1;
+			got = 0;
+			cur = 0;
+			done++;
+		}
+		report(s);
+	}
+	return have ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int udp = 0;
+	long nframes = 0;
+	const char *outname = NULL;
+	const char *port = "5005";
+	struct addrinfo hints, *ai = NULL;
+	struct stats s = {0};
+	int fd = -1, opt, ret = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "un:o:")) != -1) {
+		switch (opt) {
+		case 'u':
+			udp = 1;
+			break;
+		case 'n':
+			nframes = atol(optarg);
+			break;
+		case 'o':
+			outname = optarg;
+			break;
+		default:
+			usage();
+			return 0;
+		}
+	}
+	if (optind != argc - 1 && optind != argc - 2) {
+		usage();
+		return 0;
+	}
+	if (optind == argc - 2) {
+		port = argv[optind + 1];
+	}
+
+	char *buf = malloc(FRAME_BYTES);
+	if (!buf) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+	int err = getaddrinfo(argv[optind], port, &hints, &ai);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", argv[optind], gai_strerror(err));
+		goto done;
+	}
+
+	fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0) {
+		perror("socket");
+		goto done;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &s.start);
+	if (udp) {
+		int rcvbuf = 4 << 20;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+		if (receive_udp(fd, ai->ai_addr, ai->ai_addrlen, buf, nframes, &s))
+			goto done;
+	} else {
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			perror("connect");
+			goto done;
+		}
+		if (receive_tcp(fd, buf, nframes, &s))
+			goto done;
+	}
+
+	if (outname) {
+		const struct thermapp_packet *pkt =
+			(const struct thermapp_packet *)(buf + sizeof(struct stream_header));
+		FILE *f = fopen(outname, "wb");
+		if (!f || fwrite(pkt->pixels_data, sizeof pkt->pixels_data, 1, f) != 1) {
+			perror(outname);
+			if (f)
+				fclose(f);
+			goto done;
+		}
+		fclose(f);
+		printf("Wrote %dx%d int16 pixels to %s\n", FRAME_WIDTH, FRAME_HEIGHT, outname);
+	}
+	ret = EXIT_SUCCESS;
+
+done:
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (ai) {
+		freeaddrinfo(ai);
+	}
+	free(buf);
+	return ret;
+}